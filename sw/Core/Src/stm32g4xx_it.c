@@ -75,7 +75,12 @@ extern TIM_HandleTypeDef htim5;
 void NMI_Handler(void)
 {
   /* USER CODE BEGIN NonMaskableInt_IRQn 0 */
-
+  // Failure of the HSE detected by the clock security system. See ClockManager.c.
+  if(__HAL_RCC_GET_IT(RCC_IT_CSS))
+  {
+    HAL_RCC_NMI_IRQHandler();
+    return;
+  }
   /* USER CODE END NonMaskableInt_IRQn 0 */
   /* USER CODE BEGIN NonMaskableInt_IRQn 1 */
    while (1)
@@ -239,7 +244,7 @@ void TIM1_UP_TIM16_IRQHandler(void)
 void TIM1_CC_IRQHandler(void)
 {
   /* USER CODE BEGIN TIM1_CC_IRQn 0 */
-  captureInputISR_(&htim1);
+  captureInputTIM1ISR_();
   return;
   /* USER CODE END TIM1_CC_IRQn 0 */
   HAL_TIM_IRQHandler(&htim1);
@@ -254,7 +259,11 @@ void TIM1_CC_IRQHandler(void)
 void TIM2_IRQHandler(void)
 {
   /* USER CODE BEGIN TIM2_IRQn 0 */
-  captureInputISR_(&htim2);
+#if HW_TIMER_32BIT_TIMEBASE
+  // TIM2 is the master timer on a 32-bit timebase.
+  restartMasterTimerISR_(&htim2);
+#endif
+  captureInputTIM2ISR_();
   return;
   /* USER CODE END TIM2_IRQn 0 */
   HAL_TIM_IRQHandler(&htim2);
@@ -269,7 +278,7 @@ void TIM2_IRQHandler(void)
 void TIM3_IRQHandler(void)
 {
   /* USER CODE BEGIN TIM3_IRQn 0 */
-  captureInputISR_(&htim3);
+  captureInputTIM3ISR_();
   return;
   /* USER CODE END TIM3_IRQn 0 */
   HAL_TIM_IRQHandler(&htim3);
@@ -284,7 +293,7 @@ void TIM3_IRQHandler(void)
 void TIM4_IRQHandler(void)
 {
   /* USER CODE BEGIN TIM4_IRQn 0 */
-  captureInputISR_(&htim4);
+  captureInputTIM4ISR_();
   return;
   /* USER CODE END TIM4_IRQn 0 */
   HAL_TIM_IRQHandler(&htim4);
@@ -299,7 +308,7 @@ void TIM4_IRQHandler(void)
 void TIM5_IRQHandler(void)
 {
   /* USER CODE BEGIN TIM5_IRQn 0 */
-  captureInputISR_(&htim5);
+  captureInputTIM5ISR_();
   return;
   /* USER CODE END TIM5_IRQn 0 */
   HAL_TIM_IRQHandler(&htim5);
@@ -309,5 +318,44 @@ void TIM5_IRQHandler(void)
 }
 
 /* USER CODE BEGIN 1 */
+// DMA2 streams the captures of the channels on HW_TIMER_CAPTURE_DMA. See HWTimers.c.
+void DMA2_Channel1_IRQHandler(void)
+{
+  dmaSlotISR_(0);
+}
 
+void DMA2_Channel2_IRQHandler(void)
+{
+  dmaSlotISR_(1);
+}
+
+void DMA2_Channel3_IRQHandler(void)
+{
+  dmaSlotISR_(2);
+}
+
+void DMA2_Channel4_IRQHandler(void)
+{
+  dmaSlotISR_(3);
+}
+
+void DMA2_Channel5_IRQHandler(void)
+{
+  dmaSlotISR_(4);
+}
+
+void DMA2_Channel6_IRQHandler(void)
+{
+  dmaSlotISR_(5);
+}
+
+void DMA2_Channel7_IRQHandler(void)
+{
+  dmaSlotISR_(6);
+}
+
+void DMA2_Channel8_IRQHandler(void)
+{
+  dmaSlotISR_(7);
+}
 /* USER CODE END 1 */
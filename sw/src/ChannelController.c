@@ -13,6 +13,8 @@
 #include "ChannelController.h"
 #include "MainMCU.h"
 
+#include <string.h>
+
 void initChannelController(ChannelController* chCtrl, SPI_HandleTypeDef* hspi, 
     I2C_HandleTypeDef* hi2c1, I2C_HandleTypeDef* hi2c2) {
     if(chCtrl == NULL || hspi == NULL) return;
@@ -23,6 +25,11 @@ void initChannelController(ChannelController* chCtrl, SPI_HandleTypeDef* hspi,
     initGPIOExpander(&chCtrl->gExp3V3, hi2c1, CH_GPIO_EXP_3V3_ADDRS);
     initGPIOExpander(&chCtrl->gExp1V8, hi2c2, CH_GPIO_EXP_1V8_ADDRS);
 
+    // Without a stored table, the timestamps are sent as captured.
+    if(!loadFlashStorage(chCtrl->propagationDelays, sizeof(chCtrl->propagationDelays))) {
+        memset(chCtrl->propagationDelays, 0, sizeof(chCtrl->propagationDelays));
+    }
+
     // Set the Shift Register Enable off.
     HAL_GPIO_WritePin(SHIFT_REG_ENABLE_GPIO_Port, SHIFT_REG_ENABLE_Pin, GPIO_PIN_RESET); 
 
@@ -98,9 +105,29 @@ void initChannelFromHWTimer_(Channel* ch, HWTimerChannel* hwTimer) {
 
 void applyChannelConfiguration(Channel* ch) {
     if(ch->type == CHANNEL_TIMER) {
+        HWTimerChannel* hwTimer = ch->data.timer.timerHandler;
+        setHWTimerEnabled(hwTimer, 0);
+
+        // Only the channels that timestamp their edges take memory from the timestamp pool.
+        hwTimer->needsBuffer = (ch->mode == CHANNEL_INPUT) || 
+                               (ch->mode == CHANNEL_MONITOR_RISING_EDGES) ||
+                               (ch->mode == CHANNEL_MONITOR_FALLING_EDGES) ||
+                               (ch->mode == CHANNEL_MONITOR_BOTH_EDGES) ||
+                               (ch->mode == CHANNEL_MONITOR_PULSES) ||
+                               (ch->mode == CHANNEL_HISTOGRAM);
+        // The monitor channels feed their statistics as their timestamps are sent.
+        hwTimer->statsOnly = (ch->mode == CHANNEL_INPUT) || (ch->mode == CHANNEL_HISTOGRAM);
+        // There's a histogram slot per channel, so it can't run out.
+        setHWTimerHistogramEnabled(hwTimer, ch->mode == CHANNEL_HISTOGRAM);
+        // The stored timestamps of this channel are discarded on purpose, so they must not be 
+        // reported as lost when its buffer moves.
+        clearHWTimer(hwTimer);
+        hwTimer->pendingGap = 0;
+        distributeHWTimerPool(&hwTimers);
+
         applyTimerChannelConfig_(ch);
         // Erase the buffers.
-        empty_cb64(&ch->data.timer.timerHandler->data);
+        clearHWTimer(hwTimer);
     }else if(ch->type == CHANNEL_GPIO) {
         applyGPIOChannelConfig_(ch);
     }else {
@@ -122,6 +149,8 @@ void applyTimerChannelConfig_(Channel* ch) {
     TIM_CHANNEL_N_STATE_SET(timCh->htim, timCh->timChannel, HAL_TIM_CHANNEL_STATE_READY);
 
     HAL_GPIO_DeInit(timCh->gpioPort, timCh->gpioPin);
+    timCh->isPulseOutput = 0;
+    setHWTimerFrequencyCounter(timCh, 0);
 
     if(ch->mode == CHANNEL_DISABLED) return;
 
@@ -137,7 +166,7 @@ void applyTimerChannelConfig_(Channel* ch) {
         // Taken from stm32g4xx_hal_msp.c.
         GPIO_InitStruct.Pin = timCh->gpioPin;
         GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
-        GPIO_InitStruct.Pull = GPIO_PULLDOWN;
+        GPIO_InitStruct.Pull = (ch->mode == CHANNEL_PULSE_OUTPUT) ? GPIO_NOPULL : GPIO_PULLDOWN;
         GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
 
         if(timCh->htim->Instance==TIM1)         GPIO_InitStruct.Alternate = GPIO_AF6_TIM1;
@@ -148,21 +177,35 @@ void applyTimerChannelConfig_(Channel* ch) {
         
         HAL_GPIO_Init(timCh->gpioPort, &GPIO_InitStruct);
 
+        if(ch->mode == CHANNEL_PULSE_OUTPUT) {
+            // The edges are placed by the output compare of the TIMx, which also enables the IRQ.
+            startHWTimerPulseOutput(timCh);
+            return;
+        }
+
         // Set the mode of the HW Timers.
         TIM_IC_InitTypeDef sConfigIC = {0};
         sConfigIC.ICSelection = TIM_ICSELECTION_DIRECTTI;
         sConfigIC.ICPrescaler = TIM_ICPSC_DIV1;
-        sConfigIC.ICFilter = 0;
+        sConfigIC.ICFilter = timCh->icFilter;
     
         if(ch->mode == CHANNEL_MONITOR_RISING_EDGES) {
             sConfigIC.ICPolarity = TIM_INPUTCHANNELPOLARITY_RISING;
+            sConfigIC.ICPrescaler = timCh->icPrescaler;
         }else if(ch->mode == CHANNEL_MONITOR_FALLING_EDGES) {
             sConfigIC.ICPolarity = TIM_INPUTCHANNELPOLARITY_FALLING;
-        }else if((ch->mode == CHANNEL_MONITOR_BOTH_EDGES) || 
-                 (ch->mode == CHANNEL_INPUT) || 
-                 (ch->mode == CHANNEL_FREQUENCY)) {
+            sConfigIC.ICPrescaler = timCh->icPrescaler;
+        }else if((ch->mode == CHANNEL_MONITOR_BOTH_EDGES) || (ch->mode == CHANNEL_INPUT) ||
+                 (ch->mode == CHANNEL_MONITOR_PULSES) || (ch->mode == CHANNEL_HISTOGRAM)) {
             sConfigIC.ICPolarity = TIM_INPUTCHANNELPOLARITY_BOTHEDGE;
+        }else if(ch->mode == CHANNEL_FREQUENCY) {
+            // The prescaler counts the edges, the captures only time them.
+            sConfigIC.ICPolarity = TIM_INPUTCHANNELPOLARITY_RISING;
+            sConfigIC.ICPrescaler = HW_TIMER_FREQ_PRESCALER;
+            // Without a DMA slot to count the captures, the channel stays disabled.
+            if(!setHWTimerFrequencyCounter(timCh, 1)) return;
         }
+        timCh->icPolarity = sConfigIC.ICPolarity;
     
         if (HAL_TIM_IC_ConfigChannel(timCh->htim,
                                      &sConfigIC, 
@@ -215,14 +258,15 @@ void setShiftRegisterValues(ChannelController* channelController) {
         stDataOut->statusRed = (ch->mode == CHANNEL_DISABLED);
 
         // RE/DE signals.
+        uint8_t isOutput = (ch->mode == CHANNEL_OUTPUT) || (ch->mode == CHANNEL_PULSE_OUTPUT);
         stDataOut->re = 
             ((ch->protocol != CHANNEL_PROTOC_LVDS) && (ch->mode != CHANNEL_DISABLED)) || 
-            ((ch->protocol == CHANNEL_PROTOC_LVDS) && (ch->mode == CHANNEL_OUTPUT));
+            ((ch->protocol == CHANNEL_PROTOC_LVDS) && isOutput);
 
         stDataOut->de = (ch->protocol == CHANNEL_PROTOC_LVDS);
 
         // To set the DIR pin.
-        stDataOut->isOut = (ch->mode == CHANNEL_OUTPUT);
+        stDataOut->isOut = isOutput;
     }
 
     HAL_SPI_Transmit(
@@ -244,6 +288,59 @@ Channel* getChannelFromNumber(uint32_t channelNumber) {
     return &chCtrl.channels[channelNumber];
 }
 
+int32_t getChannelPropagationDelay(Channel* ch) {
+    if((ch == NULL) || (ch->type != CHANNEL_TIMER)) return 0;
+
+    uint8_t index = getProtocolIndex_(ch->protocol);
+    if(index >= CH_PROTOCOL_COUNT) return 0;
+
+    // The Timer channels are the first ones, so their number is also their row on the table.
+    return chCtrl.propagationDelays[ch - chCtrl.channels][index];
+}
+
+uint8_t getPropagationDelay(uint32_t channelNumber, GPIOProtocol protocol, int32_t* delay) {
+    uint8_t index = getProtocolIndex_(protocol);
+    if((channelNumber >= CH_CONT_TIMER_COUNT) || (index >= CH_PROTOCOL_COUNT) || (delay == NULL)) {
+        return 0;
+    }
+
+    *delay = chCtrl.propagationDelays[channelNumber][index];
+    return 1;
+}
+
+uint8_t setPropagationDelay(uint32_t channelNumber, GPIOProtocol protocol, int32_t delay) {
+    uint8_t index = getProtocolIndex_(protocol);
+    if((channelNumber >= CH_CONT_TIMER_COUNT) || (index >= CH_PROTOCOL_COUNT)) return 0;
+
+    if(chCtrl.propagationDelays[channelNumber][index] == delay) return 1;
+
+    // No ISR runs while the flash is erased, as their vectors are on the flash. The captures of 
+    // the 16-bit TIMx would be extended with the wrong timebase, so the channels must be stopped.
+    if(!areHWTimersIdle(&hwTimers)) return 0;
+
+    // The table is only changed once it is stored.
+    int32_t previousDelay = chCtrl.propagationDelays[channelNumber][index];
+    chCtrl.propagationDelays[channelNumber][index] = delay;
+    startHWTimebaseStall(&hwTimers);
+    uint8_t saved = saveFlashStorage(chCtrl.propagationDelays, sizeof(chCtrl.propagationDelays));
+    endHWTimebaseStall(&hwTimers);
+    if(!saved) {
+        chCtrl.propagationDelays[channelNumber][index] = previousDelay;
+        return 0;
+    }
+    return 1;
+}
+
+uint8_t getProtocolIndex_(GPIOProtocol protocol) {
+    switch (protocol) {
+        case CHANNEL_PROTOC_LVDS:   return 0;
+        case CHANNEL_PROTOC_5V:     return 1;
+        case CHANNEL_PROTOC_3V3:    return 2;
+        case CHANNEL_PROTOC_1V8:    return 3;
+        default:                    return CH_PROTOCOL_COUNT;
+    }
+}
+
 GPIOExpander* getGPIOExpanderFromGPIOChannel_(Channel* ch) {
     if((ch == NULL) || (ch->type != CHANNEL_GPIO)) return NULL;
 
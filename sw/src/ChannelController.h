@@ -17,6 +17,7 @@
 #include "HWTimers.h"
 #include "TCA6416.h"
 #include "CommsProtocol.h"
+#include "FlashStorage.h"
 
 #define CH_CONT_TIMER_COUNT     HW_TIMER_CHANNEL_COUNT
 #define CH_CONT_GPIO_COUNT      16
@@ -26,6 +27,9 @@
 #define CH_GPIO_EXP_3V3_ADDRS 0b0100001
 #define CH_GPIO_EXP_1V8_ADDRS 0b0100000
 
+// Each protocol goes through a different transceiver: LVDS, 5V, 3V3 and 1V8.
+#define CH_PROTOCOL_COUNT     4
+
 // Channels can be related to TIMx or GPIOs.
 typedef enum ChannelType {
     CHANNEL_TIMER = 1,
@@ -76,6 +80,10 @@ typedef struct ChannelController {
     GPIOExpander gExp5V;
     GPIOExpander gExp3V3;
     GPIOExpander gExp1V8;
+
+    // Delay from the connector to the TIMx of each Timer channel and protocol, in ns. It is
+    // subtracted from the timestamps when they are sent. Stored on the flash.
+    int32_t propagationDelays[CH_CONT_TIMER_COUNT][CH_PROTOCOL_COUNT];
 } ChannelController;
 
 /**************************************** FUNCTION *************************************************
@@ -124,6 +132,39 @@ uint8_t setChannelState(Channel* ch, uint8_t newState);
 ***************************************************************************************************/
 uint8_t getChannelState(Channel* ch, uint8_t* currentState);
 
+/**************************************** FUNCTION *************************************************
+ * @brief Gets the propagation delay of a Timer channel on its current protocol.
+ * @param ch. The channel.
+ * @return The delay in ns, or 0 if the channel is not a Timer channel or it is disabled.
+***************************************************************************************************/
+int32_t getChannelPropagationDelay(Channel* ch);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Gets the propagation delay of a Timer channel on a protocol.
+ * @param channelNumber. The channel number.
+ * @param protocol. The protocol, other than CHANNEL_PROTOC_OFF.
+ * @param delay. Where the delay in ns will be stored.
+ * @return 1 if the channel and protocol are valid.
+***************************************************************************************************/
+uint8_t getPropagationDelay(uint32_t channelNumber, GPIOProtocol protocol, int32_t* delay);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Sets the propagation delay of a Timer channel on a protocol and stores the whole table on
+ * the flash. Only while all Timer channels are disabled, as the flash erase stalls their ISRs.
+ * @param channelNumber. The channel number.
+ * @param protocol. The protocol, other than CHANNEL_PROTOC_OFF.
+ * @param delay. The delay in ns.
+ * @return 1 if the delay was set and stored. Otherwise, the delay is left as it was.
+***************************************************************************************************/
+uint8_t setPropagationDelay(uint32_t channelNumber, GPIOProtocol protocol, int32_t delay);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Gets the index of a protocol on the propagation delay table.
+ * @param protocol. The protocol.
+ * @return The index, or CH_PROTOCOL_COUNT if the protocol has no delay.
+***************************************************************************************************/
+uint8_t getProtocolIndex_(GPIOProtocol protocol);
+
 /**************************************** FUNCTION *************************************************
  * @brief Initializes Channel from a TimerChannel data.
  * @param ch. Pointer to the channel to initialize.
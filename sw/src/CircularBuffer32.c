@@ -0,0 +1,69 @@
+/***************************************************************************************************
+ * @file CircularBuffer32.c
+ * @brief A lock-free single-producer/single-consumer Circular or Ring buffer for 32 bit data.
+ * 
+ * @project MIDDS
+ * @version 1.0
+ * @date    2025-08-06
+ * @author  @dabecart
+ * 
+ * @license This project is licensed under the MIT License - see the LICENSE file for details.
+***************************************************************************************************/
+
+#include "CircularBuffer32.h"
+
+void init_cb32(CircularBuffer32* pCB, uint32_t* storage, uint32_t bufferSize) {
+    if(pCB == NULL) return;
+
+    // Round down to a power of two so that the indices can be masked.
+    uint32_t size = 0;
+    if((storage != NULL) && (bufferSize > 0)) {
+        size = 1;
+        while((size << 1) <= bufferSize) size <<= 1;
+    }
+
+    pCB->data = storage;
+    pCB->size = size;
+    pCB->mask = size - 1;
+    pCB->head = 0;
+    pCB->tail = 0;
+}
+
+// Called by the timer ISRs.
+CCM_CODE inline uint8_t push_cb32(CircularBuffer32* pCB, uint32_t item) {
+    uint32_t head = pCB->head;
+    if((head - pCB->tail) >= pCB->size) return 0;
+
+    pCB->data[head & pCB->mask] = item;
+    // The item must be written before the consumer sees the new head.
+    __DMB();
+    pCB->head = head + 1;
+    return 1;
+}
+
+// Called by the timer ISRs.
+CCM_CODE inline uint8_t pushN_cb32(CircularBuffer32* pCB, const uint32_t* items, uint32_t count) {
+    uint32_t head = pCB->head;
+    if((head - pCB->tail + count) > pCB->size) return 0;
+
+    for(uint32_t i = 0; i < count; i++) {
+        pCB->data[(head + i) & pCB->mask] = items[i];
+    }
+    // Publish all the items with a single head update.
+    __DMB();
+    pCB->head = head + count;
+    return 1;
+}
+
+inline uint8_t pop_cb32(CircularBuffer32* pCB, uint32_t* item) {
+    uint32_t tail = pCB->tail;
+    if(pCB->head == tail) return 0;
+
+    // Read the item only after having seen the head that covers it.
+    __DMB();
+    *item = pCB->data[tail & pCB->mask];
+    // The item must be read before the producer can overwrite it.
+    __DMB();
+    pCB->tail = tail + 1;
+    return 1;
+}
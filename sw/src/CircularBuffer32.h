@@ -0,0 +1,81 @@
+/***************************************************************************************************
+ * @file CircularBuffer32.h
+ * @brief A lock-free single-producer/single-consumer Circular or Ring buffer for 32 bit data.
+ * 
+ * @project MIDDS
+ * @version 1.0
+ * @date    2025-08-06
+ * @author  @dabecart
+ * 
+ * @license This project is licensed under the MIT License - see the LICENSE file for details.
+***************************************************************************************************/
+
+#ifndef CIRCULAR_BUFFER_32_h
+#define CIRCULAR_BUFFER_32_h
+
+#include <string.h>
+#include <stdint.h>
+
+#include "cmsis_compiler.h"
+
+#include "LinkerSections.h"
+
+// Same rules as the CircularBuffer64: one producer writing head, one consumer writing tail. Both
+// indices run freely and are masked when accessing data.
+// The memory of the buffer is given on init_cb32().
+typedef struct 
+{
+    uint32_t            size;   // Full size of the buffer. A power of two, or zero.
+    uint32_t            mask;   // size - 1.
+    volatile uint32_t   head;   // Index to write to (producer).
+    volatile uint32_t   tail;   // Index to read from (consumer).
+    uint32_t*           data;   // Data buffer.
+} CircularBuffer32;
+
+/**************************************** FUNCTION *************************************************
+ * @brief Starts a CircularBuffer32. Must not be called while the producer is running.
+ * @param pCB. Pointer to the CircularBuffer32 struct.
+ * @param storage. Memory of the buffer, at least bufferSize items long. If NULL, the buffer will
+ * have no space and all pushes will fail.
+ * @param bufferSize. Size of the buffer to be instantiated. It gets rounded down to a power of two.
+ * @return None 
+***************************************************************************************************/
+void init_cb32(CircularBuffer32* pCB, uint32_t* storage, uint32_t bufferSize);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Returns the number of stored items. As seen by the consumer, it can only grow until the 
+ * next pop.
+ * @param pCB. Pointer to the CircularBuffer32 struct.
+ * @return The number of items that can be popped.
+***************************************************************************************************/
+static inline uint32_t len_cb32(const CircularBuffer32* pCB) {
+    return pCB->head - pCB->tail;
+}
+
+/**************************************** FUNCTION *************************************************
+ * @brief Pushes a single item into a CircularBuffer32. Advances the head index. Producer only.
+ * @param pCB. Pointer to the CircularBuffer32 struct.
+ * @param item. Item to be store into the buffer.
+ * @return 1 if the push was successful, 0 if the buffer is full.
+***************************************************************************************************/
+uint8_t push_cb32(CircularBuffer32* pCB, uint32_t item);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Pushes N items into a CircularBuffer32. The consumer sees all of them at once or none of 
+ * them. Producer only.
+ * @param pCB. Pointer to the CircularBuffer32 struct.
+ * @param items. Items to be stored into the buffer.
+ * @param count. Number of items to push.
+ * @return 1 if the push was successful, 0 if there's no space for all the items.
+***************************************************************************************************/
+uint8_t pushN_cb32(CircularBuffer32* pCB, const uint32_t* items, uint32_t count);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Reads an item from a CircularBuffer32. Advances the tail index. Consumer only.
+ * @param pCB. Pointer to the CircularBuffer32 struct.
+ * @param item. Where the popped item will be stored.
+ * @return 1 if the read item is valid. 
+***************************************************************************************************/
+uint8_t pop_cb32(CircularBuffer32* pCB, uint32_t* item);
+
+#endif // CIRCULAR_BUFFER_32_h
@@ -1,6 +1,6 @@
 /***************************************************************************************************
  * @file CircularBuffer64.c
- * @brief A simple Circular or Ring buffer implementation for 64 bit data.
+ * @brief A lock-free single-producer/single-consumer Circular or Ring buffer for 64 bit data.
  * 
  * @project MIDDS
  * @version 1.0
@@ -12,48 +12,73 @@
 
 #include "CircularBuffer64.h"
 
-void init_cb64(CircularBuffer64* pCB, uint32_t bufferSize) {
+void init_cb64(CircularBuffer64* pCB, uint64_t* storage, uint32_t bufferSize) {
     if(pCB == NULL) return;
 
-    pCB->size = bufferSize;
-    pCB->len  = 0;
+    // Round down to a power of two so that the indices can be masked.
+    uint32_t size = 0;
+    if((storage != NULL) && (bufferSize > 0)) {
+        size = 1;
+        while((size << 1) <= bufferSize) size <<= 1;
+    }
+
+    pCB->data = storage;
+    pCB->size = size;
+    pCB->mask = size - 1;
     pCB->head = 0;
     pCB->tail = 0;
-    pCB->locked = 0;
 }
 
 void empty_cb64(CircularBuffer64* pCB) {
     if(pCB == NULL) return;
     
-    pCB->tail = 0;
-    pCB->head = 0;
-    pCB->len = 0;
-    memset(pCB->data, 0, pCB->size * sizeof(uint64_t));
+    pCB->tail = pCB->head;
+}
+
+// Called by the timer ISRs.
+CCM_CODE inline uint8_t push_cb64(CircularBuffer64* pCB, uint64_t ucItem) {
+    uint32_t head = pCB->head;
+    if((head - pCB->tail) >= pCB->size) return 0;
+
+    pCB->data[head & pCB->mask] = ucItem;
+    // The item must be written before the consumer sees the new head.
+    __DMB();
+    pCB->head = head + 1;
+    return 1;
 }
 
-inline uint8_t push_cb64(CircularBuffer64* pCB, uint64_t ucItem) {
-    if(pCB->locked || (pCB->len >= pCB->size)) return 0;
+// Called by the timer ISRs.
+CCM_CODE inline uint8_t pushN_cb64(CircularBuffer64* pCB, const uint64_t* items, uint32_t count) {
+    uint32_t head = pCB->head;
+    if((head - pCB->tail + count) > pCB->size) return 0;
 
-    pCB->data[pCB->head] = ucItem;
-    pCB->head++;
-    if(pCB->head >= pCB->size) pCB->head = 0;
-    pCB->len++; 
+    for(uint32_t i = 0; i < count; i++) {
+        pCB->data[(head + i) & pCB->mask] = items[i];
+    }
+    // Publish all the items with a single head update.
+    __DMB();
+    pCB->head = head + count;
     return 1;
 }
 
 inline uint8_t pop_cb64(CircularBuffer64* pCB, uint64_t* item) {
-    if(pCB->len < 1) return 0;
+    uint32_t tail = pCB->tail;
+    if(pCB->head == tail) return 0;
 
-    *item = pCB->data[pCB->tail];
-    pCB->tail++;
-    if(pCB->tail >= pCB->size) pCB->tail = 0;
-    pCB->len--;
+    // Read the item only after having seen the head that covers it.
+    __DMB();
+    *item = pCB->data[tail & pCB->mask];
+    // The item must be read before the producer can overwrite it.
+    __DMB();
+    pCB->tail = tail + 1;
     return 1;
 }
 
 inline uint8_t peek_cb64(CircularBuffer64* pCB, uint64_t* item) {
-    if(pCB->len < 1) return 0;
+    uint32_t tail = pCB->tail;
+    if(pCB->head == tail) return 0;
     
-    *item = pCB->data[pCB->tail];
+    __DMB();
+    *item = pCB->data[tail & pCB->mask];
     return 1;
 }
@@ -1,6 +1,6 @@
 /***************************************************************************************************
  * @file CircularBuffer64.h
- * @brief A simple Circular or Ring buffer implementation for 64 bit data.
+ * @brief A lock-free single-producer/single-consumer Circular or Ring buffer for 64 bit data.
  * 
  * @project MIDDS
  * @version 1.0
@@ -16,54 +16,83 @@
 #include <string.h>
 #include <stdint.h>
 
-#define CIRCULAR_BUFFER_64_MAX_SIZE 200
+#include "cmsis_compiler.h"
 
+#include "LinkerSections.h"
+
+// Only one context can push (the producer, normally an ISR) and only one context can pop (the 
+// consumer, normally the main loop). The producer only writes head and the consumer only writes 
+// tail, so neither of them has to disable the interrupts or lock the buffer. Both indices run 
+// freely and are masked when accessing data, so head - tail is always the number of stored items.
+// The memory of the buffer is given on init_cb64().
 typedef struct 
 {
-    uint32_t    size;                               // Full size of the buffer.    
-    uint32_t    len;                                // Number of bytes to read (stored bytes count).
-    uint32_t    head;                               // Index to read from.
-    uint32_t    tail;                               // Index to write to.
-    uint64_t    data[CIRCULAR_BUFFER_64_MAX_SIZE];  // Data buffer.
-    uint8_t     locked;                             // 1 to disable pushing into the buffer.
-} __attribute__((__packed__)) CircularBuffer64;
+    uint32_t            size;   // Full size of the buffer. A power of two, or zero.
+    uint32_t            mask;   // size - 1.
+    volatile uint32_t   head;   // Index to write to (producer).
+    volatile uint32_t   tail;   // Index to read from (consumer).
+    uint64_t*           data;   // Data buffer.
+} CircularBuffer64;
 
 /**************************************** FUNCTION *************************************************
- * @brief Starts a CircularBuffer64.
+ * @brief Starts a CircularBuffer64. Must not be called while the producer is running.
  * @param pCB. Pointer to the CircularBuffer64 struct.
- * @param bufferSize. Size of the buffer to be instantiated.
+ * @param storage. Memory of the buffer, at least bufferSize items long. If NULL, the buffer will
+ * have no space and all pushes will fail.
+ * @param bufferSize. Size of the buffer to be instantiated. It gets rounded down to a power of two.
  * @return None 
 ***************************************************************************************************/
-void init_cb64(CircularBuffer64* pCB, uint32_t bufferSize);
+void init_cb64(CircularBuffer64* pCB, uint64_t* storage, uint32_t bufferSize);
 
 /**************************************** FUNCTION *************************************************
- * @brief Empties the content of a cb64.
+ * @brief Empties the content of a cb64. Called from the consumer side: it discards all the items
+ * pushed up to this point.
  * @param pCB. Pointer to the CircularBuffer64 struct.
 ***************************************************************************************************/
 void empty_cb64(CircularBuffer64* pCB);
 
 /**************************************** FUNCTION *************************************************
- * @brief Pushes a single byte into a CircularBuffer64. Advances the tail index.
+ * @brief Returns the number of stored items. As seen by the consumer, it can only grow until the 
+ * next pop.
+ * @param pCB. Pointer to the CircularBuffer64 struct.
+ * @return The number of items that can be popped.
+***************************************************************************************************/
+static inline uint32_t len_cb64(const CircularBuffer64* pCB) {
+    return pCB->head - pCB->tail;
+}
+
+/**************************************** FUNCTION *************************************************
+ * @brief Pushes a single item into a CircularBuffer64. Advances the head index. Producer only.
  * @param pCB. Pointer to the CircularBuffer64 struct.
- * @param item. Byte to be store into the buffer.
- * @return 1 if the push was successful. 
+ * @param item. Item to be store into the buffer.
+ * @return 1 if the push was successful, 0 if the buffer is full.
 ***************************************************************************************************/
 uint8_t push_cb64(CircularBuffer64* pCB, uint64_t item);
 
 /**************************************** FUNCTION *************************************************
- * @brief Reads a byte from a CircularBuffer64. Advances the head index.
+ * @brief Pushes N items into a CircularBuffer64. The consumer sees all of them at once or none of 
+ * them. Producer only.
+ * @param pCB. Pointer to the CircularBuffer64 struct.
+ * @param items. Items to be stored into the buffer.
+ * @param count. Number of items to push.
+ * @return 1 if the push was successful, 0 if there's no space for all the items.
+***************************************************************************************************/
+uint8_t pushN_cb64(CircularBuffer64* pCB, const uint64_t* items, uint32_t count);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Reads an item from a CircularBuffer64. Advances the tail index. Consumer only.
  * @param pCB. Pointer to the CircularBuffer64 struct.
- * @param item. Where the popped byte will be stored.
+ * @param item. Where the popped item will be stored.
  * @return 1 if the read item is valid. 
 ***************************************************************************************************/
 uint8_t pop_cb64(CircularBuffer64* pCB, uint64_t* item);
 
 /**************************************** FUNCTION *************************************************
- * @brief Reads a byte from a CircularBuffer64. Does not advance the head index.
+ * @brief Reads an item from a CircularBuffer64. Does not advance the tail index. Consumer only.
  * @param pCB. Pointer to the CircularBuffer64 struct.
- * @param item. Where the read byte will be stored.
+ * @param item. Where the read item will be stored.
  * @return 1 if the read item is valid. 
 ***************************************************************************************************/
 uint8_t peek_cb64(CircularBuffer64* pCB, uint64_t* item);
 
-#endif // CIRCULAR_BUFFER_64_h
\ No newline at end of file
+#endif // CIRCULAR_BUFFER_64_h
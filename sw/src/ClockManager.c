@@ -0,0 +1,189 @@
+/***************************************************************************************************
+ * @file ClockManager.c
+ * @brief Selection of the clock source of the MCU: the 10 MHz reference (onboard TCXO or the SMA
+ * input) when present, or the HSI otherwise.
+ *
+ * @project MIDDS
+ * @version 1.0
+ * @date    2025-08-07
+ * @author  @dabecart
+ *
+ * @license This project is licensed under the MIT License - see the LICENSE file for details.
+***************************************************************************************************/
+
+#include "ClockManager.h"
+#include "MainMCU.h"
+
+#include <string.h>
+
+ClockStatus clockStatus = {
+    .source = CLOCK_SOURCE_HSI,
+    .frequency = MCU_FREQUENCY,
+    .tickNsNumerator = MCU_TICK_NS_NUMERATOR,
+    .tickNsDenominator = MCU_TICK_NS_DENOMINATOR,
+};
+
+// Odd while clockStatus is being written. The NMI can't be masked, so getClockStatus() copies it
+// again if the sequence changed during the copy.
+volatile uint32_t clockStatusSequence = 0;
+// Set by the NMI when the reference is lost. processClockManager() moves the PLL to the HSI.
+volatile uint8_t pendingClockFailure = 0;
+// Set once the timer channels have been stopped because the PLL couldn't be restored.
+uint8_t clockFailureReported = 0;
+
+void initClockManager() {
+    // SystemClock_Config() leaves the PLL on the HSI. The HSE only gets ready if there's a clock on
+    // its input, so this is also the detection of the reference.
+    RCC_OscInitTypeDef oscInit = {0};
+    oscInit.OscillatorType = RCC_OSCILLATORTYPE_HSE;
+    oscInit.HSEState = RCC_HSE_BYPASS;
+    oscInit.PLL.PLLState = RCC_PLL_NONE;
+    if(HAL_RCC_OscConfig(&oscInit) != HAL_OK) {
+        oscInit.HSEState = RCC_HSE_OFF;
+        HAL_RCC_OscConfig(&oscInit);
+        updateTickPeriod_();
+        return;
+    }
+
+    if(!configurePLL_(RCC_PLLSOURCE_HSE, HSE_VALUE)) {
+        // The reference can't give MCU_FREQUENCY. Go back to the HSI.
+        configurePLL_(RCC_PLLSOURCE_HSI, HSI_VALUE);
+        oscInit.HSEState = RCC_HSE_OFF;
+        HAL_RCC_OscConfig(&oscInit);
+        updateTickPeriod_();
+        return;
+    }
+
+    // Both 10 MHz references go through the same pin. The SCK jumper tells which one is connected.
+    if(HAL_GPIO_ReadPin(SELECTED_SCK_GPIO_Port, SELECTED_SCK_Pin) == CLOCK_SELECTED_SCK_EXTERNAL) {
+        clockStatus.source = CLOCK_SOURCE_EXTERNAL;
+    }else {
+        clockStatus.source = CLOCK_SOURCE_TCXO;
+    }
+    updateTickPeriod_();
+
+    // If the reference stops, the SYSCLK is moved to the HSI by hardware and HAL_RCC_CSSCallback()
+    // is called from the NMI.
+    HAL_RCC_EnableCSS();
+}
+
+void getClockStatus(ClockStatus* status) {
+    if(status == NULL) return;
+
+    uint32_t sequence;
+    do {
+        sequence = clockStatusSequence;
+        __DMB();
+        memcpy(status, &clockStatus, sizeof(ClockStatus));
+        __DMB();
+    }while((sequence & 1) || (sequence != clockStatusSequence));
+}
+
+void processClockManager() {
+    if(!pendingClockFailure) return;
+
+    // The reference is lost and the SYSCLK is the HSI at 16 MHz. Get MCU_FREQUENCY back from the
+    // HSI. Out of the NMI, so that the HAL timeouts run.
+    if(!configurePLL_(RCC_PLLSOURCE_HSI, HSI_VALUE)) {
+        // The timestamps would keep being converted with the ticks of MCU_FREQUENCY, so the timer
+        // channels are stopped until they are configured again. The PLL is retried on every loop.
+        if(!clockFailureReported) {
+            clockFailureReported = 1;
+            for(uint16_t i = 0; i < HW_TIMER_CHANNEL_COUNT; i++) {
+                setHWTimerEnabled(hwTimers.channels + i, 0);
+            }
+            sendErrorMessage(COMMS_ERROR_INTERNAL);
+        }
+        return;
+    }
+    pendingClockFailure = 0;
+    clockFailureReported = 0;
+
+    clockStatusSequence++;
+    __DMB();
+    updateTickPeriod_();
+    __DMB();
+    clockStatusSequence++;
+
+    // The TIMx are back at MCU_FREQUENCY: the end of the gap marked by the NMI.
+    markHWTimersClockGap(&hwTimers);
+}
+
+uint8_t configurePLL_(uint32_t pllSource, uint32_t sourceFrequency) {
+    // The PLL can't be changed while it is the SYSCLK.
+    RCC_ClkInitTypeDef clkInit = {0};
+    clkInit.ClockType = RCC_CLOCKTYPE_SYSCLK;
+    clkInit.SYSCLKSource = RCC_SYSCLKSOURCE_HSI;
+    if(HAL_RCC_ClockConfig(&clkInit, FLASH_LATENCY_4) != HAL_OK) return 0;
+
+    // Smallest M and its N that give exactly MCU_FREQUENCY = source/M*N/2.
+    uint32_t pllM = 0, pllN = 0;
+    for(uint32_t m = 1; m <= 16; m++) {
+        if((sourceFrequency / m) > 16000000UL) continue;
+        if((sourceFrequency / m) < 2660000UL) break;
+
+        uint64_t target = 2*MCU_FREQUENCY*m;
+        if((target % sourceFrequency) != 0) continue;
+        uint64_t n = target / sourceFrequency;
+        if((n < CLOCK_PLL_MIN_N) || (n > CLOCK_PLL_MAX_N)) continue;
+
+        pllM = m;
+        pllN = n;
+        break;
+    }
+    if(pllM == 0) return 0;
+
+    RCC_OscInitTypeDef oscInit = {0};
+    oscInit.OscillatorType = RCC_OSCILLATORTYPE_NONE;
+    oscInit.PLL.PLLState = RCC_PLL_ON;
+    oscInit.PLL.PLLSource = pllSource;
+    oscInit.PLL.PLLM = pllM;
+    oscInit.PLL.PLLN = pllN;
+    oscInit.PLL.PLLP = RCC_PLLP_DIV2;
+    oscInit.PLL.PLLQ = RCC_PLLQ_DIV4;
+    oscInit.PLL.PLLR = RCC_PLLR_DIV2;
+    if(HAL_RCC_OscConfig(&oscInit) != HAL_OK) return 0;
+
+    // Above 80 MHz, the HAL goes through an AHB prescaler of 2 for the boost mode.
+    clkInit.ClockType = RCC_CLOCKTYPE_HCLK | RCC_CLOCKTYPE_SYSCLK |
+                        RCC_CLOCKTYPE_PCLK1 | RCC_CLOCKTYPE_PCLK2;
+    clkInit.SYSCLKSource = RCC_SYSCLKSOURCE_PLLCLK;
+    clkInit.AHBCLKDivider = RCC_SYSCLK_DIV1;
+    clkInit.APB1CLKDivider = RCC_HCLK_DIV1;
+    clkInit.APB2CLKDivider = RCC_HCLK_DIV1;
+    return HAL_RCC_ClockConfig(&clkInit, FLASH_LATENCY_4) == HAL_OK;
+}
+
+void updateTickPeriod_() {
+    uint32_t frequency = HAL_RCC_GetSysClockFreq();
+    uint32_t numerator = 1000000000UL, denominator = frequency;
+
+    // Reduce the fraction with the greatest common divisor.
+    uint32_t a = numerator, b = denominator;
+    while(b != 0) {
+        uint32_t r = a % b;
+        a = b;
+        b = r;
+    }
+    if(a == 0) return;
+
+    clockStatus.frequency = frequency;
+    clockStatus.tickNsNumerator = numerator / a;
+    clockStatus.tickNsDenominator = denominator / a;
+}
+
+void HAL_RCC_CSSCallback() {
+    // The hardware has already moved the SYSCLK to the HSI and the HAL clears the CSS flag. Only 
+    // record the failure here: the PLL is reconfigured by processClockManager().
+    clockStatusSequence++;
+    __DMB();
+    clockStatus.source = CLOCK_SOURCE_HSI;
+    clockStatus.failureCount++;
+    updateTickPeriod_();
+    __DMB();
+    clockStatusSequence++;
+
+    // The TIMx count at 16 MHz from now on.
+    markHWTimersClockGap(&hwTimers);
+    pendingClockFailure = 1;
+}
@@ -0,0 +1,89 @@
+/***************************************************************************************************
+ * @file ClockManager.h
+ * @brief Selection of the clock source of the MCU: the 10 MHz reference (onboard TCXO or the SMA
+ * input) when present, or the HSI otherwise.
+ *
+ * @project MIDDS
+ * @version 1.0
+ * @date    2025-08-07
+ * @author  @dabecart
+ *
+ * @license This project is licensed under the MIT License - see the LICENSE file for details.
+***************************************************************************************************/
+
+#ifndef CLOCK_MANAGER_h
+#define CLOCK_MANAGER_h
+
+#include <stdint.h>
+
+#include "stm32g4xx_hal.h"
+
+#include "main.h"
+
+// Level of SELECTED_SCK when the SCK jumper selects the SMA input (Ext) instead of the TCXO (Int).
+#define CLOCK_SELECTED_SCK_EXTERNAL     GPIO_PIN_SET
+
+// The PLL input must be within 2.66 and 16 MHz, and the VCO within 96 and 344 MHz. The PLL is
+// divided by two to get the SYSCLK.
+#define CLOCK_PLL_MIN_N                 8
+#define CLOCK_PLL_MAX_N                 127
+
+// Clock sources of the MCU.
+typedef enum ClockSource {
+    // Internal RC oscillator: 16 MHz, 1% on the whole temperature range.
+    CLOCK_SOURCE_HSI = 0,
+    // Onboard 10 MHz TCXO, through the HSE on bypass.
+    CLOCK_SOURCE_TCXO,
+    // External 10 MHz from the SMA connector, through the HSE on bypass.
+    CLOCK_SOURCE_EXTERNAL,
+} ClockSource;
+
+// Clock of the MCU, read with getClockStatus().
+typedef struct ClockStatus {
+    ClockSource source;
+    // SYSCLK frequency, in Hz. The TIMx count at this rate.
+    uint32_t    frequency;
+    // Duration of a tick in ns, as a reduced fraction: tickNsNumerator/tickNsDenominator.
+    uint32_t    tickNsNumerator;
+    uint32_t    tickNsDenominator;
+    // Times that the clock security system has detected a failure of the HSE.
+    uint32_t    failureCount;
+} ClockStatus;
+
+/**************************************** FUNCTION *************************************************
+ * @brief Moves the PLL to the 10 MHz reference if there's a clock on the HSE, keeping the SYSCLK at
+ * MCU_FREQUENCY. Otherwise, the PLL stays on the HSI. Must be called after the GPIOs are
+ * initialized and before the timers are started.
+***************************************************************************************************/
+void initClockManager();
+
+/**************************************** FUNCTION *************************************************
+ * @brief Copies the status of the clock. Safe against the clock security system NMI updating it
+ * during the copy.
+ * @param status. Where the status will be stored.
+***************************************************************************************************/
+void getClockStatus(ClockStatus* status);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Brings the SYSCLK back to MCU_FREQUENCY from the HSI after the reference has been lost. 
+ * Until then, the MCU runs at 16 MHz and a gap is marked on every channel at both ends. If the PLL
+ * can't be configured, the timer channels are stopped, an RR_INTERNAL error is sent and it is 
+ * retried on the next calls. Called from the main loop.
+***************************************************************************************************/
+void processClockManager();
+
+/**************************************** FUNCTION *************************************************
+ * @brief Configures the PLL from a source to get MCU_FREQUENCY on the SYSCLK. The SYSCLK is moved
+ * to the HSI while the PLL is reconfigured.
+ * @param pllSource. RCC_PLLSOURCE_HSI or RCC_PLLSOURCE_HSE.
+ * @param sourceFrequency. Frequency of the source, in Hz.
+ * @return 1 if the SYSCLK runs from the PLL at MCU_FREQUENCY.
+***************************************************************************************************/
+uint8_t configurePLL_(uint32_t pllSource, uint32_t sourceFrequency);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Calculates the tick duration of the current SYSCLK.
+***************************************************************************************************/
+void updateTickPeriod_();
+
+#endif // CLOCK_MANAGER_h
@@ -12,6 +12,7 @@
 
 #include "Comms.h"
 #include "MainMCU.h"
+#include "FixedPoint.h"
 
 // This buffer gets filled inside "usbd_cdc_if.c"'s "CDC_Receive_FS" function.
 CircularBuffer inputBuffer;
@@ -112,6 +113,56 @@ uint8_t encodeGPIOMessage(const ChannelMessageType msgType, const ChannelMessage
             break;
         }
 
+        case GPIO_MSG_PULSES: {
+            messageLen = encodePulses(msg.monitor, outMsgBuffer, maxLength);
+            break;
+        }
+
+        case GPIO_MSG_PROFILER: {
+            messageLen = encodeProfiler(&msg.profiler, outMsgBuffer);
+            break;
+        }
+
+        case GPIO_MSG_LOST_EDGES: {
+            messageLen = encodeLostEdges(&msg.lostEdges, outMsgBuffer);
+            break;
+        }
+
+        case GPIO_MSG_SYNC_QUALITY: {
+            messageLen = encodeSyncQuality(&msg.syncQuality, outMsgBuffer);
+            break;
+        }
+
+        case GPIO_MSG_CLOCK_STATUS: {
+            messageLen = encodeClockStatus(&msg.clockStatus, outMsgBuffer);
+            break;
+        }
+
+        case GPIO_MSG_CALIBRATION: {
+            messageLen = encodeCalibration(&msg.calibration, outMsgBuffer);
+            break;
+        }
+
+        case GPIO_MSG_PROPAGATION_DELAY: {
+            messageLen = encodePropagationDelay(&msg.propagationDelay, outMsgBuffer);
+            break;
+        }
+
+        case GPIO_MSG_TIMEBASE: {
+            messageLen = encodeTimebase(&msg.timebase, outMsgBuffer);
+            break;
+        }
+
+        case GPIO_MSG_STATISTICS: {
+            messageLen = encodeStatistics(&msg.statistics, outMsgBuffer);
+            break;
+        }
+
+        case GPIO_MSG_HISTOGRAM: {
+            messageLen = encodeHistogram(&msg.histogram, outMsgBuffer, maxLength);
+            break;
+        }
+
         case GPIO_MSG_ERROR: {
             messageLen = encodeError(&msg.error, outMsgBuffer, maxLength);
             break;
@@ -179,6 +230,62 @@ int32_t decodeGPIOMessage(const uint8_t* dataBuffer, const uint32_t dataLen) {
 
         messageLen = COMMS_MSG_SYNC_SETT_LEN;
         executeSyncSettingsCommand(&temp);
+    }else if(strncmp(messageID, COMMS_MSG_CHANNEL_EXT_SETT_HEAD, strlen(COMMS_MSG_CHANNEL_EXT_SETT_HEAD)) == 0) {
+        ChannelSettingsExtended temp = {};
+        if(dataLen < COMMS_MSG_CHANNEL_EXT_SETT_LEN)    return COMMS_DECODE_NOT_ENOUGH_DATA;
+        if(!decodeSettingsExtended(dataBuffer, &temp))  return COMMS_DECODE_ERROR_DECODING;
+
+        messageLen = COMMS_MSG_CHANNEL_EXT_SETT_LEN;
+        executeExtendedSettingsCommand(&temp);
+    }else if(strncmp(messageID, COMMS_MSG_PROFILER_HEAD, strlen(COMMS_MSG_PROFILER_HEAD)) == 0) {
+        ChannelProfiler temp = {};
+        if(dataLen < COMMS_MSG_PROFILER_LEN)            return COMMS_DECODE_NOT_ENOUGH_DATA;
+        if(!decodeProfiler(dataBuffer, &temp))          return COMMS_DECODE_ERROR_DECODING;
+
+        messageLen = COMMS_MSG_PROFILER_LEN;
+        executeProfilerCommand(&temp);
+    }else if(strncmp(messageID, COMMS_MSG_LOST_EDGES_HEAD, strlen(COMMS_MSG_LOST_EDGES_HEAD)) == 0) {
+        ChannelLostEdges temp = {};
+        if(dataLen < COMMS_MSG_LOST_EDGES_LEN)          return COMMS_DECODE_NOT_ENOUGH_DATA;
+        if(!decodeLostEdges(dataBuffer, &temp))         return COMMS_DECODE_ERROR_DECODING;
+
+        messageLen = COMMS_MSG_LOST_EDGES_LEN;
+        executeLostEdgesCommand(&temp);
+    }else if(strncmp(messageID, COMMS_MSG_HISTOGRAM_HEAD, strlen(COMMS_MSG_HISTOGRAM_HEAD)) == 0) {
+        ChannelHistogram temp = {};
+        if(dataLen < COMMS_MSG_HISTOGRAM_LEN)           return COMMS_DECODE_NOT_ENOUGH_DATA;
+        if(!decodeHistogram(dataBuffer, &temp))         return COMMS_DECODE_ERROR_DECODING;
+
+        messageLen = COMMS_MSG_HISTOGRAM_LEN;
+        executeHistogramCommand(&temp);
+    }else if(strncmp(messageID, COMMS_MSG_SYNC_QUALITY_HEAD, strlen(COMMS_MSG_SYNC_QUALITY_HEAD)) == 0) {
+        ChannelSyncQuality temp = {};
+        if(dataLen < COMMS_MSG_SYNC_QUALITY_LEN)        return COMMS_DECODE_NOT_ENOUGH_DATA;
+        if(!decodeSyncQuality(dataBuffer, &temp))       return COMMS_DECODE_ERROR_DECODING;
+
+        messageLen = COMMS_MSG_SYNC_QUALITY_LEN;
+        executeSyncQualityCommand(&temp);
+    }else if(strncmp(messageID, COMMS_MSG_CLOCK_STATUS_HEAD, strlen(COMMS_MSG_CLOCK_STATUS_HEAD)) == 0) {
+        ChannelClockStatus temp = {};
+        if(dataLen < COMMS_MSG_CLOCK_STATUS_LEN)        return COMMS_DECODE_NOT_ENOUGH_DATA;
+        if(!decodeClockStatus(dataBuffer, &temp))       return COMMS_DECODE_ERROR_DECODING;
+
+        messageLen = COMMS_MSG_CLOCK_STATUS_LEN;
+        executeClockStatusCommand(&temp);
+    }else if(strncmp(messageID, COMMS_MSG_CALIBRATION_HEAD, strlen(COMMS_MSG_CALIBRATION_HEAD)) == 0) {
+        ChannelCalibration temp = {};
+        if(dataLen < COMMS_MSG_CALIBRATION_LEN)         return COMMS_DECODE_NOT_ENOUGH_DATA;
+        if(!decodeCalibration(dataBuffer, &temp))       return COMMS_DECODE_ERROR_DECODING;
+
+        messageLen = COMMS_MSG_CALIBRATION_LEN;
+        executeCalibrationCommand(&temp);
+    }else if(strncmp(messageID, COMMS_MSG_PROPAGATION_DELAY_HEAD, strlen(COMMS_MSG_PROPAGATION_DELAY_HEAD)) == 0) {
+        ChannelPropagationDelay temp = {};
+        if(dataLen < COMMS_MSG_PROPAGATION_DELAY_LEN)   return COMMS_DECODE_NOT_ENOUGH_DATA;
+        if(!decodePropagationDelay(dataBuffer, &temp))  return COMMS_DECODE_ERROR_DECODING;
+
+        messageLen = COMMS_MSG_PROPAGATION_DELAY_LEN;
+        executePropagationDelayCommand(&temp);
     }else if(strncmp(messageID, COMMS_MSG_CONNECT_HEAD, strlen(COMMS_MSG_CONNECT_HEAD)) == 0) {
         messageLen = COMMS_MSG_CONN_LEN;
         establishConnection(1);
@@ -204,31 +311,57 @@ uint16_t encodeInput(const ChannelInput* dataStruct, uint8_t* outBuffer) {
 }
 
 uint16_t encodeMonitor(HWTimerChannel* hwTimer, uint8_t* outBuffer, const uint16_t maxMsgLen){
-    if((hwTimer == NULL) || (outBuffer == NULL) || 
-       (hwTimer->data.len == 0) || (maxMsgLen < COMMS_MIN_MONITOR_MSG_LEN)){
+    if((hwTimer == NULL) || (outBuffer == NULL) || (maxMsgLen < COMMS_MIN_MONITOR_MSG_LEN) ||
+       ((getHWTimerBufferLength(hwTimer) == 0) && (hwTimer->pendingMarker == 0))){
         return 0;
     } 
 
-    uint16_t messageCount = hwTimer->data.len;   // Make it constant at this point.
-    if(messageCount > COMMS_MAX_TIMESTAMPS_IN_MONITOR) {
-        messageCount = COMMS_MAX_TIMESTAMPS_IN_MONITOR;
+    // An overload marker goes before the timestamps. When the channel goes back to raw timestamps,
+    // it is followed by the current SYNC tag, as the ones stored meanwhile were not sent.
+    uint64_t markers[2] = {hwTimer->pendingMarker, HW_TIMER_SYNC_TAG_MARKER | hwTimer->popSyncTag};
+    uint32_t markerCount = 0;
+    if(hwTimer->pendingMarker != 0) {
+        markerCount = 
+            (hwTimer->rawTimestamps && !(hwTimer->pendingMarker & HW_TIMER_OVERLOAD_START)) ? 2 : 1;
     }
 
     uint16_t maxMessageCount = (maxMsgLen - COMMS_MSG_MONITOR_HEADER_LEN)/COMMS_MONITOR_TIMESTAMP_LEN;
-    if(messageCount > maxMessageCount) {
-        messageCount = maxMessageCount;
+    if(markerCount > maxMessageCount) return 0;
+
+    PROFILER_START();
+
+    // Make it constant at this point. The ISR may keep pushing while the message is encoded. It 
+    // also counts the epoch markers, so fewer timestamps may be popped. While overloaded, only the 
+    // marker is sent.
+    uint32_t entryCount = hwTimer->overloaded ? 0 : getHWTimerBufferLength(hwTimer);
+    uint32_t maxTimestamps = entryCount + markerCount;
+    if(maxTimestamps > COMMS_MAX_TIMESTAMPS_IN_MONITOR) {
+        maxTimestamps = COMMS_MAX_TIMESTAMPS_IN_MONITOR;
+    }
+
+    if(maxTimestamps > maxMessageCount) {
+        maxTimestamps = maxMessageCount;
     }
     
-    // To make the pop_cb64, this header must be a multiple of eight bytes long (in binary output 
-    // mode at least).
+    // The header goes at the start, but it is filled once the timestamps are known. To make the 
+    // memcpy aligned, this header must be a multiple of eight bytes long (in binary output mode at
+    // least).
     uint16_t msgSize = COMMS_MSG_MONITOR_HEADER_LEN;
-    sprintf((char*) outBuffer, "%c%s%02d%04d", 
-            COMMS_MSG_SYNC, COMMS_MSG_MONITOR_HEAD, hwTimer->channelNumber, messageCount);
+    uint32_t messageCount = 0;
+    hwTimer->pendingMarker = 0;
+
+    // Raw timestamps are sent as stored, with their SYNC tags. The computer corrects them.
+    uint8_t (*popTimestamp)(HWTimerChannel*, uint64_t*, uint32_t*) = 
+        hwTimer->rawTimestamps ? popHWTimerRawTimestamp : popHWTimerTimestamp;
 
 #if MCU_TX_IN_ASCII
+    for(; messageCount < markerCount; messageCount++) {
+        msgSize += snprintf64Hex(outBuffer + msgSize, maxMsgLen - msgSize, markers[messageCount]);
+    }
+
     uint64_t readVal;
-    for(uint8_t countIndex = 0; countIndex < messageCount; countIndex++) {
-        pop_cb64(&hwTimer->data, &readVal);
+    while((messageCount < maxTimestamps) && popTimestamp(hwTimer, &readVal, &entryCount)) {
+        messageCount++;
         msgSize += snprintf64Hex(
                         outBuffer + msgSize, 
                         maxMsgLen - msgSize,
@@ -240,20 +373,126 @@ uint16_t encodeMonitor(HWTimerChannel* hwTimer, uint8_t* outBuffer, const uint16
     }
     msgSize += snprintf(outBuffer + msgSize, maxMsgLen-msgSize, "\n");
 #else
-    uint64_t readVal;
-    for(uint32_t countIndex = 0; countIndex < messageCount; countIndex++) {
-        pop_cb64(&hwTimer->data, &readVal);
+    memcpy(outBuffer + msgSize, markers, markerCount*COMMS_MONITOR_TIMESTAMP_LEN);
+    msgSize += markerCount*COMMS_MONITOR_TIMESTAMP_LEN;
+    messageCount += markerCount;
+
+    // The timestamps are popped in batches, so the conversion and the copy run over whole arrays.
+    uint64_t batch[COMMS_MONITOR_BATCH_SIZE];
+    Channel* ch = getChannelFromNumber(hwTimer->channelNumber);
+    int32_t propagationDelay = getChannelPropagationDelay(ch);
+    while(messageCount < maxTimestamps) {
+        uint32_t batchMax = maxTimestamps - messageCount;
+        if(batchMax > COMMS_MONITOR_BATCH_SIZE) batchMax = COMMS_MONITOR_BATCH_SIZE;
+
+        uint32_t batchCount = 0;
+        while((batchCount < batchMax) && 
+              popTimestamp(hwTimer, batch + batchCount, &entryCount)) {
+            batchCount++;
+        }
+        if(batchCount == 0) break;
+
+        if(!hwTimer->rawTimestamps) {
+            // Only the full batches are profiled, so the mean cycles of the site divided by 
+            // COMMS_MONITOR_BATCH_SIZE are the cycles per timestamp.
+            PROFILER_START();
+            convertTimestampsToUNIXTime(batch, batchCount, propagationDelay);
+            if(batchCount == COMMS_MONITOR_BATCH_SIZE) {
+                PROFILER_END(PROFILER_SITE_CONVERT_TIME);
+            }
+        }
 
-        // The LSB is the value of the channel (HIGH or LOW). The rest is the timestamp in internal 
-        // time. Convert to UNIX time the timestamp, shift it to the left one bit and add the value
-        // of the channel.
-        readVal = (convertFromInternalToUNIXTime(readVal >> 1) << 1) | (readVal & 0x01ULL);
+        memcpy(outBuffer + msgSize, batch, batchCount*COMMS_MONITOR_TIMESTAMP_LEN);
+        msgSize += batchCount*COMMS_MONITOR_TIMESTAMP_LEN;
+        messageCount += batchCount;
 
-        memcpy(outBuffer + msgSize, &readVal, COMMS_MONITOR_TIMESTAMP_LEN);
-        msgSize += COMMS_MONITOR_TIMESTAMP_LEN;
+        // The buffer has been emptied.
+        if(batchCount < batchMax) break;
     }
 #endif
 
+    // sprintf adds a null character, which would overwrite the first timestamp.
+    char header[COMMS_MSG_MONITOR_HEADER_LEN + 1];
+    sprintf(header, "%c%s%02d%04ld", 
+            COMMS_MSG_SYNC, COMMS_MSG_MONITOR_HEAD, hwTimer->channelNumber, messageCount);
+    memcpy(outBuffer, header, COMMS_MSG_MONITOR_HEADER_LEN);
+
+    hwTimer->lastPrintTick = HAL_GetTick();
+
+    PROFILER_END(PROFILER_SITE_ENCODE_MONITOR);
+    return msgSize;
+}
+
+uint16_t encodePulses(HWTimerChannel* hwTimer, uint8_t* outBuffer, const uint16_t maxMsgLen) {
+    if((hwTimer == NULL) || (outBuffer == NULL) || (maxMsgLen < COMMS_MIN_PULSES_MSG_LEN) ||
+       ((getHWTimerBufferLength(hwTimer) == 0) && (hwTimer->pendingMarker == 0))){
+        return 0;
+    }
+
+    // The markers go before the pulses as records of width 0, like on encodeMonitor().
+    uint64_t markers[2] = {hwTimer->pendingMarker, HW_TIMER_SYNC_TAG_MARKER | hwTimer->popSyncTag};
+    uint32_t markerCount = 0;
+    if(hwTimer->pendingMarker != 0) {
+        markerCount = 
+            (hwTimer->rawTimestamps && !(hwTimer->pendingMarker & HW_TIMER_OVERLOAD_START)) ? 2 : 1;
+    }
+
+    uint16_t maxRecordCount = (maxMsgLen - COMMS_MSG_PULSES_HEADER_LEN)/COMMS_PULSES_RECORD_LEN;
+    if(markerCount > maxRecordCount) return 0;
+    if(maxRecordCount > COMMS_MAX_TIMESTAMPS_IN_MONITOR) {
+        maxRecordCount = COMMS_MAX_TIMESTAMPS_IN_MONITOR;
+    }
+
+    // Make it constant at this point. While overloaded, only the marker is sent.
+    uint32_t entryCount = hwTimer->overloaded ? 0 : getHWTimerBufferLength(hwTimer);
+    uint16_t msgSize = COMMS_MSG_PULSES_HEADER_LEN;
+    uint32_t recordCount = 0;
+    uint32_t width = 0;
+    hwTimer->pendingMarker = 0;
+
+    for(; recordCount < markerCount; recordCount++) {
+        memcpy(outBuffer + msgSize, markers + recordCount, sizeof(uint64_t));
+        memcpy(outBuffer + msgSize + sizeof(uint64_t), &width, sizeof(width));
+        msgSize += COMMS_PULSES_RECORD_LEN;
+    }
+
+    // The pulses are popped in batches, so the starts are converted at once.
+    uint64_t starts[COMMS_MONITOR_BATCH_SIZE];
+    uint32_t widths[COMMS_MONITOR_BATCH_SIZE];
+    Channel* ch = getChannelFromNumber(hwTimer->channelNumber);
+    int32_t propagationDelay = getChannelPropagationDelay(ch);
+    while(recordCount < maxRecordCount) {
+        uint32_t batchMax = maxRecordCount - recordCount;
+        if(batchMax > COMMS_MONITOR_BATCH_SIZE) batchMax = COMMS_MONITOR_BATCH_SIZE;
+
+        uint32_t batchCount = 0;
+        while((batchCount < batchMax) && 
+              popHWTimerPulse(hwTimer, starts + batchCount, widths + batchCount, &entryCount)) {
+            batchCount++;
+        }
+        if(batchCount == 0) break;
+
+        if(!hwTimer->rawTimestamps) {
+            convertTimestampsToUNIXTime(starts, batchCount, propagationDelay);
+        }
+
+        for(uint32_t i = 0; i < batchCount; i++) {
+            memcpy(outBuffer + msgSize, starts + i, sizeof(uint64_t));
+            memcpy(outBuffer + msgSize + sizeof(uint64_t), widths + i, sizeof(uint32_t));
+            msgSize += COMMS_PULSES_RECORD_LEN;
+        }
+        recordCount += batchCount;
+
+        // The buffer has been emptied.
+        if(batchCount < batchMax) break;
+    }
+
+    // sprintf adds a null character, which would overwrite the first record.
+    char header[COMMS_MSG_PULSES_HEADER_LEN + 1];
+    sprintf(header, "%c%s%02d%04ld", 
+            COMMS_MSG_SYNC, COMMS_MSG_PULSES_HEAD, hwTimer->channelNumber, recordCount);
+    memcpy(outBuffer, header, COMMS_MSG_PULSES_HEADER_LEN);
+
     hwTimer->lastPrintTick = HAL_GetTick();
     return msgSize;
 }
@@ -274,6 +513,261 @@ uint16_t encodeFrequency(const ChannelFrequency* dataStruct, uint8_t* outBuffer)
     return len + sizeof(dataStruct->time);
 }
 
+uint16_t encodeProfiler(const ChannelProfiler* dataStruct, uint8_t* outBuffer) {
+    if(dataStruct == NULL || outBuffer == NULL) return 0;
+
+    ProfilerSiteStats stats;
+    if(!getProfilerSiteStats(dataStruct->site, &stats)) return 0;
+    if(dataStruct->action == COMMS_PROFILER_READ_AND_CLEAR) {
+        clearProfilerSite(dataStruct->site);
+    }
+
+    uint32_t minCycles  = (stats.count > 0) ? stats.minCycles : 0;
+    uint32_t meanCycles = (stats.count > 0) ? (stats.totalCycles / stats.count) : 0;
+
+    uint16_t len = sprintf((char*) outBuffer, 
+                           "%c%s%02ld", 
+                           COMMS_MSG_SYNC, COMMS_MSG_PROFILER_HEAD,
+                           dataStruct->site);
+    memcpy(outBuffer + len, &stats.count, sizeof(stats.count));
+    len += sizeof(stats.count);
+
+    memcpy(outBuffer + len, &minCycles, sizeof(minCycles));
+    len += sizeof(minCycles);
+
+    memcpy(outBuffer + len, &stats.maxCycles, sizeof(stats.maxCycles));
+    len += sizeof(stats.maxCycles);
+
+    memcpy(outBuffer + len, &meanCycles, sizeof(meanCycles));
+    len += sizeof(meanCycles);
+
+    memcpy(outBuffer + len, stats.histogram, sizeof(stats.histogram));
+    return len + sizeof(stats.histogram);
+}
+
+uint16_t encodeLostEdges(const ChannelLostEdges* dataStruct, uint8_t* outBuffer) {
+    if(dataStruct == NULL || outBuffer == NULL) return 0;
+
+    Channel* ch = getChannelFromNumber(dataStruct->channel);
+    if((ch == NULL) || (ch->type != CHANNEL_TIMER)) return 0;
+
+    uint32_t droppedCount, overcaptureCount;
+    getHWTimerLostEdges(ch->data.timer.timerHandler, &droppedCount, &overcaptureCount,
+                        dataStruct->action == COMMS_LOST_EDGES_READ_AND_CLEAR);
+
+    uint16_t len = sprintf((char*) outBuffer, 
+                           "%c%s%02ld", 
+                           COMMS_MSG_SYNC, COMMS_MSG_LOST_EDGES_HEAD,
+                           dataStruct->channel);
+    memcpy(outBuffer + len, &droppedCount, sizeof(droppedCount));
+    len += sizeof(droppedCount);
+
+    memcpy(outBuffer + len, &overcaptureCount, sizeof(overcaptureCount));
+    return len + sizeof(overcaptureCount);
+}
+
+uint16_t encodeSyncQuality(const ChannelSyncQuality* dataStruct, uint8_t* outBuffer) {
+    if(dataStruct == NULL || outBuffer == NULL) return 0;
+
+    HWTimerSyncStatus status;
+    getSyncStatus(&status);
+
+    uint8_t  quality = status.quality;
+    // Deviation of the MCU clock from the SYNC, in parts per billion.
+    int32_t  frequencyPPB = (int64_t)(status.scaleQ48 - FIXED_POINT_Q48_ONE) * 1e9 / 
+                            FIXED_POINT_Q48_ONE;
+    int32_t  phaseErrorNs = (status.phaseError * 1000000000LL) / (int64_t) MCU_FREQUENCY;
+    uint32_t msSinceLastSync = status.ticksSinceLastSync / (MCU_FREQUENCY / 1000);
+
+    uint16_t len = sprintf((char*) outBuffer, 
+                           "%c%s", 
+                           COMMS_MSG_SYNC, COMMS_MSG_SYNC_QUALITY_HEAD);
+    memcpy(outBuffer + len, &quality, sizeof(quality));
+    len += sizeof(quality);
+
+    memcpy(outBuffer + len, &frequencyPPB, sizeof(frequencyPPB));
+    len += sizeof(frequencyPPB);
+
+    memcpy(outBuffer + len, &phaseErrorNs, sizeof(phaseErrorNs));
+    len += sizeof(phaseErrorNs);
+
+    memcpy(outBuffer + len, &msSinceLastSync, sizeof(msSinceLastSync));
+    len += sizeof(msSinceLastSync);
+
+    memcpy(outBuffer + len, &status.glitchCount, sizeof(status.glitchCount));
+    return len + sizeof(status.glitchCount);
+}
+
+uint16_t encodeClockStatus(const ChannelClockStatus* dataStruct, uint8_t* outBuffer) {
+    if(dataStruct == NULL || outBuffer == NULL) return 0;
+
+    ClockStatus status;
+    getClockStatus(&status);
+    uint8_t source = status.source;
+
+    uint16_t len = sprintf((char*) outBuffer, 
+                           "%c%s", 
+                           COMMS_MSG_SYNC, COMMS_MSG_CLOCK_STATUS_HEAD);
+    memcpy(outBuffer + len, &source, sizeof(source));
+    len += sizeof(source);
+
+    memcpy(outBuffer + len, &status.frequency, sizeof(status.frequency));
+    len += sizeof(status.frequency);
+
+    memcpy(outBuffer + len, &status.tickNsNumerator, sizeof(status.tickNsNumerator));
+    len += sizeof(status.tickNsNumerator);
+
+    memcpy(outBuffer + len, &status.tickNsDenominator, sizeof(status.tickNsDenominator));
+    len += sizeof(status.tickNsDenominator);
+
+    memcpy(outBuffer + len, &status.failureCount, sizeof(status.failureCount));
+    return len + sizeof(status.failureCount);
+}
+
+uint16_t encodeCalibration(const ChannelCalibration* dataStruct, uint8_t* outBuffer) {
+    if(dataStruct == NULL || outBuffer == NULL) return 0;
+
+    uint16_t len = sprintf((char*) outBuffer, 
+                           "%c%s", 
+                           COMMS_MSG_SYNC, COMMS_MSG_CALIBRATION_HEAD);
+    memcpy(outBuffer + len, hwTimers.phaseOffsets, sizeof(hwTimers.phaseOffsets));
+    return len + sizeof(hwTimers.phaseOffsets);
+}
+
+uint16_t encodePropagationDelay(const ChannelPropagationDelay* dataStruct, uint8_t* outBuffer) {
+    if(dataStruct == NULL || outBuffer == NULL) return 0;
+
+    int32_t delay;
+    if(!getPropagationDelay(dataStruct->channel, dataStruct->protocol, &delay)) return 0;
+
+    uint16_t len = sprintf((char*) outBuffer, 
+                           "%c%s%02ld%c", 
+                           COMMS_MSG_SYNC, COMMS_MSG_PROPAGATION_DELAY_HEAD,
+                           dataStruct->channel, dataStruct->protocol);
+    memcpy(outBuffer + len, &delay, sizeof(delay));
+    return len + sizeof(delay);
+}
+
+uint16_t encodeTimebase(const ChannelTimebase* dataStruct, uint8_t* outBuffer) {
+    if(dataStruct == NULL || outBuffer == NULL) return 0;
+
+    HWTimerTimebaseDescriptor descriptor;
+    if(!getTimebaseDescriptor(dataStruct->epoch, &descriptor)) return 0;
+
+    ClockStatus clock;
+    getClockStatus(&clock);
+
+    uint16_t len = sprintf((char*) outBuffer, 
+                           "%c%s", 
+                           COMMS_MSG_SYNC, COMMS_MSG_TIMEBASE_HEAD);
+    memcpy(outBuffer + len, &descriptor.syncTag, sizeof(descriptor.syncTag));
+    len += sizeof(descriptor.syncTag);
+
+    memcpy(outBuffer + len, &descriptor.record.synchronized, 
+           sizeof(descriptor.record.synchronized));
+    len += sizeof(descriptor.record.synchronized);
+
+    memcpy(outBuffer + len, &descriptor.record.measuredTime, 
+           sizeof(descriptor.record.measuredTime));
+    len += sizeof(descriptor.record.measuredTime);
+
+    memcpy(outBuffer + len, &descriptor.record.idealTime, sizeof(descriptor.record.idealTime));
+    len += sizeof(descriptor.record.idealTime);
+
+    memcpy(outBuffer + len, &descriptor.record.scaleQ48, sizeof(descriptor.record.scaleQ48));
+    len += sizeof(descriptor.record.scaleQ48);
+
+    memcpy(outBuffer + len, &clock.tickNsNumerator, sizeof(clock.tickNsNumerator));
+    len += sizeof(clock.tickNsNumerator);
+
+    memcpy(outBuffer + len, &clock.tickNsDenominator, sizeof(clock.tickNsDenominator));
+    len += sizeof(clock.tickNsDenominator);
+
+    memcpy(outBuffer + len, &descriptor.internalTime, sizeof(descriptor.internalTime));
+    return len + sizeof(descriptor.internalTime);
+}
+
+uint16_t encodeStatistics(const ChannelStatistics* dataStruct, uint8_t* outBuffer) {
+    if(dataStruct == NULL || outBuffer == NULL) return 0;
+
+    const HWTimerStatsReport* report = &dataStruct->report;
+    uint64_t minPeriod = convertFromInternalToUNIXTime(report->minPeriod);
+    uint64_t maxPeriod = convertFromInternalToUNIXTime(report->maxPeriod);
+    uint64_t meanPeriod = convertFromInternalToUNIXTime(report->meanPeriod);
+    uint64_t time = convertFromInternalToUNIXTime(getMIDDSTime(&hwTimers));
+
+    uint16_t len = sprintf((char*) outBuffer, 
+                           "%c%s%02ld", 
+                           COMMS_MSG_SYNC, COMMS_MSG_STATISTICS_HEAD, dataStruct->channel);
+    memcpy(outBuffer + len, &report->edgeCount, sizeof(report->edgeCount));
+    len += sizeof(report->edgeCount);
+
+    memcpy(outBuffer + len, &report->cycleCount, sizeof(report->cycleCount));
+    len += sizeof(report->cycleCount);
+
+    memcpy(outBuffer + len, &minPeriod, sizeof(minPeriod));
+    len += sizeof(minPeriod);
+
+    memcpy(outBuffer + len, &maxPeriod, sizeof(maxPeriod));
+    len += sizeof(maxPeriod);
+
+    memcpy(outBuffer + len, &meanPeriod, sizeof(meanPeriod));
+    len += sizeof(meanPeriod);
+
+    memcpy(outBuffer + len, &report->dutyCycle, sizeof(report->dutyCycle));
+    len += sizeof(report->dutyCycle);
+
+    memcpy(outBuffer + len, &time, sizeof(time));
+    return len + sizeof(time);
+}
+
+uint16_t encodeHistogram(const ChannelHistogram* dataStruct, uint8_t* outBuffer, 
+                         const uint16_t maxMsgLen) {
+    if(dataStruct == NULL || outBuffer == NULL) return 0;
+
+    Channel* ch = getChannelFromNumber(dataStruct->channel);
+    if((ch == NULL) || (ch->type != CHANNEL_TIMER)) return 0;
+
+    // The histogram is only cleared once it is sure to be sent.
+    HWTimerChannel* hwTimer = ch->data.timer.timerHandler;
+    const HWTimerHistogram* histogram = &hwTimer->histogram;
+    if(histogram->slot == NULL) return 0;
+    HWTimerHistogramKind kind = dataStruct->kind;
+    uint32_t binsSize = histogram->binCount*sizeof(uint32_t);
+    if((COMMS_MSG_HISTOGRAM_HEADER_LEN + binsSize) > maxMsgLen) return 0;
+
+    uint64_t binStart = convertFromInternalToUNIXTime(histogram->binStart);
+    uint64_t binWidth = convertFromInternalToUNIXTime(histogram->binWidth);
+    uint64_t time = convertFromInternalToUNIXTime(getMIDDSTime(&hwTimers));
+
+    uint16_t len = sprintf((char*) outBuffer, 
+                           "%c%s%02ld%c%02d", 
+                           COMMS_MSG_SYNC, COMMS_MSG_HISTOGRAM_HEAD, dataStruct->channel,
+                           COMMS_HISTOGRAM_KIND_IDS[kind], histogram->binCount);
+    memcpy(outBuffer + len, &binStart, sizeof(binStart));
+    len += sizeof(binStart);
+
+    memcpy(outBuffer + len, &binWidth, sizeof(binWidth));
+    len += sizeof(binWidth);
+
+    memcpy(outBuffer + len, &histogram->underflow[kind], sizeof(histogram->underflow[kind]));
+    len += sizeof(histogram->underflow[kind]);
+
+    memcpy(outBuffer + len, &histogram->overflow[kind], sizeof(histogram->overflow[kind]));
+    len += sizeof(histogram->overflow[kind]);
+
+    memcpy(outBuffer + len, &time, sizeof(time));
+    len += sizeof(time);
+
+    memcpy(outBuffer + len, histogram->slot->bins[kind], binsSize);
+    len += binsSize;
+
+    if(dataStruct->action == COMMS_HISTOGRAM_READ_AND_CLEAR) {
+        clearHWTimerHistogramKind(hwTimer, kind);
+    }
+    return len;
+}
+
 uint16_t encodeError(const ChannelError* dataStruct, uint8_t* outBuffer, const uint16_t maxMsgLen) {
     if(dataStruct == NULL || outBuffer == NULL) return 0;
     return snprintf((char*) outBuffer, maxMsgLen, 
@@ -323,17 +817,19 @@ uint8_t decodeSettingsChannel(const uint8_t* dataBuffer, ChannelSettingsChannel
     }else if(strncmp(modeIdentifier, COMMS_SETT_CH_OUTPUT, strlen(COMMS_SETT_CH_OUTPUT)) == 0) {
         decodedMsg->mode = CHANNEL_OUTPUT;
     }else if(strncmp(modeIdentifier, COMMS_SETT_CH_FREQUENCY, strlen(COMMS_SETT_CH_FREQUENCY)) == 0) {
-    //     decodedMsg->mode = CHANNEL_FREQUENCY;
-        // TODO: Frequency mode is still not implemented. Only input channels can calculate 
-        // frequency at the moment.
-        sendErrorMessage(COMMS_ERROR_INTERNAL);
-        return 0;
+        decodedMsg->mode = CHANNEL_FREQUENCY;
+    }else if(strncmp(modeIdentifier, COMMS_SETT_CH_PULSE_OUTPUT, strlen(COMMS_SETT_CH_PULSE_OUTPUT)) == 0) {
+        decodedMsg->mode = CHANNEL_PULSE_OUTPUT;
     }else if(strncmp(modeIdentifier, COMMS_SETT_CH_MONITOR_RISING, strlen(COMMS_SETT_CH_MONITOR_RISING)) == 0) {
         decodedMsg->mode = CHANNEL_MONITOR_RISING_EDGES;
     }else if(strncmp(modeIdentifier, COMMS_SETT_CH_MONITOR_FALLING, strlen(COMMS_SETT_CH_MONITOR_FALLING)) == 0) {
         decodedMsg->mode = CHANNEL_MONITOR_FALLING_EDGES;
     }else if(strncmp(modeIdentifier, COMMS_SETT_CH_MONITOR_BOTH, strlen(COMMS_SETT_CH_MONITOR_BOTH)) == 0) {
         decodedMsg->mode = CHANNEL_MONITOR_BOTH_EDGES;
+    }else if(strncmp(modeIdentifier, COMMS_SETT_CH_MONITOR_PULSES, strlen(COMMS_SETT_CH_MONITOR_PULSES)) == 0) {
+        decodedMsg->mode = CHANNEL_MONITOR_PULSES;
+    }else if(strncmp(modeIdentifier, COMMS_SETT_CH_HISTOGRAM, strlen(COMMS_SETT_CH_HISTOGRAM)) == 0) {
+        decodedMsg->mode = CHANNEL_HISTOGRAM;
     }else if(strncmp(modeIdentifier, COMMS_SETT_CH_DISABLED, strlen(COMMS_SETT_CH_DISABLED)) == 0) {
         decodedMsg->mode = CHANNEL_DISABLED;
     }else {
@@ -361,6 +857,76 @@ uint8_t decodeSettingsChannel(const uint8_t* dataBuffer, ChannelSettingsChannel
     return 1;
 }
 
+uint8_t decodeSettingsExtended(const uint8_t* dataBuffer, ChannelSettingsExtended *decodedMsg) {
+    if((dataBuffer == NULL) || (decodedMsg == NULL)) return 0;
+
+    decodedMsg->command     = COMMS_MSG_CHANNEL_EXT_SETT_HEAD[0];
+    decodedMsg->subCommand  = COMMS_MSG_CHANNEL_EXT_SETT_HEAD[1];
+    decodedMsg->channel = getChannelNumberFromBuffer(dataBuffer + 3);
+    memcpy(decodedMsg->key, dataBuffer + 5, sizeof(decodedMsg->key));
+    memcpy(&decodedMsg->value, dataBuffer + 7, sizeof(decodedMsg->value));
+    return 1;
+}
+
+uint8_t decodeProfiler(const uint8_t* dataBuffer, ChannelProfiler *decodedMsg) {
+    if((dataBuffer == NULL) || (decodedMsg == NULL)) return 0;
+
+    decodedMsg->command = COMMS_MSG_PROFILER_HEAD[0];
+    decodedMsg->site    = getChannelNumberFromBuffer(dataBuffer + 2);
+    decodedMsg->action  = dataBuffer[4];
+    return 1;
+}
+
+uint8_t decodeLostEdges(const uint8_t* dataBuffer, ChannelLostEdges *decodedMsg) {
+    if((dataBuffer == NULL) || (decodedMsg == NULL)) return 0;
+
+    decodedMsg->command = COMMS_MSG_LOST_EDGES_HEAD[0];
+    decodedMsg->channel = getChannelNumberFromBuffer(dataBuffer + 2);
+    decodedMsg->action  = dataBuffer[4];
+    return 1;
+}
+
+uint8_t decodeHistogram(const uint8_t* dataBuffer, ChannelHistogram *decodedMsg) {
+    if((dataBuffer == NULL) || (decodedMsg == NULL)) return 0;
+
+    decodedMsg->command = COMMS_MSG_HISTOGRAM_HEAD[0];
+    decodedMsg->channel = getChannelNumberFromBuffer(dataBuffer + 2);
+    decodedMsg->action  = dataBuffer[4];
+    return 1;
+}
+
+uint8_t decodeSyncQuality(const uint8_t* dataBuffer, ChannelSyncQuality *decodedMsg) {
+    if((dataBuffer == NULL) || (decodedMsg == NULL)) return 0;
+
+    decodedMsg->command = COMMS_MSG_SYNC_QUALITY_HEAD[0];
+    return 1;
+}
+
+uint8_t decodeClockStatus(const uint8_t* dataBuffer, ChannelClockStatus *decodedMsg) {
+    if((dataBuffer == NULL) || (decodedMsg == NULL)) return 0;
+
+    decodedMsg->command = COMMS_MSG_CLOCK_STATUS_HEAD[0];
+    return 1;
+}
+
+uint8_t decodeCalibration(const uint8_t* dataBuffer, ChannelCalibration *decodedMsg) {
+    if((dataBuffer == NULL) || (decodedMsg == NULL)) return 0;
+
+    decodedMsg->command = COMMS_MSG_CALIBRATION_HEAD[0];
+    return 1;
+}
+
+uint8_t decodePropagationDelay(const uint8_t* dataBuffer, ChannelPropagationDelay *decodedMsg) {
+    if((dataBuffer == NULL) || (decodedMsg == NULL)) return 0;
+
+    decodedMsg->command  = COMMS_MSG_PROPAGATION_DELAY_HEAD[0];
+    decodedMsg->channel  = getChannelNumberFromBuffer(dataBuffer + 5);
+    decodedMsg->protocol = dataBuffer[7];
+    decodedMsg->action   = dataBuffer[8];
+    memcpy(&decodedMsg->delay, dataBuffer + 9, sizeof(decodedMsg->delay));
+    return 1;
+}
+
 uint8_t decodeSettingsSync(const uint8_t* dataBuffer, ChannelSettingsSYNC *decodedMsg) {
     if((dataBuffer == NULL) || (decodedMsg == NULL)) return 0;
 
@@ -484,13 +1050,21 @@ uint8_t executeFrequencyCommand(const ChannelFrequency* cmdInput) {
     }
 
     // Only if the channel is an output or disabled, return error.
-    if((ch->mode != CHANNEL_INPUT) && (ch->mode != CHANNEL_FREQUENCY)) {
+    if((ch->mode != CHANNEL_INPUT) && (ch->mode != CHANNEL_FREQUENCY) &&
+       (ch->mode != CHANNEL_MONITOR_RISING_EDGES) && (ch->mode != CHANNEL_MONITOR_FALLING_EDGES) &&
+       (ch->mode != CHANNEL_MONITOR_BOTH_EDGES) && (ch->mode != CHANNEL_MONITOR_PULSES) &&
+       (ch->mode != CHANNEL_HISTOGRAM)) {
         sendErrorMessage(COMMS_ERROR_INVALID_MODE);
         return 0;
     }
 
     memcpy(&cmdResponse.frequency, cmdInput, sizeof(ChannelFrequency));
-    if(ch->type == CHANNEL_TIMER) {
+    if((ch->type == CHANNEL_TIMER) && (ch->mode == CHANNEL_FREQUENCY)) {
+        // Only the rising edges are counted, so there's no duty cycle.
+        cmdResponse.frequency.frequency = 
+            getHWTimerCounterFrequency(ch->data.timer.timerHandler);
+        cmdResponse.frequency.dutyCycle = -1.0;
+    }else if(ch->type == CHANNEL_TIMER) {
         getChannelFrequencyAndDutyCycle(ch->data.timer.timerHandler, 
                                         &cmdResponse.frequency.frequency, 
                                         &cmdResponse.frequency.dutyCycle);
@@ -522,6 +1096,21 @@ uint8_t executeChannelSettingsCommand(const ChannelSettingsChannel* cmdInput) {
         return 0;
     }
 
+    // The pulses are generated, counted, paired and binned by the TIMx channels.
+    if((ch->type != CHANNEL_TIMER) && 
+       ((cmdInput->mode == CHANNEL_PULSE_OUTPUT) || (cmdInput->mode == CHANNEL_FREQUENCY) ||
+        (cmdInput->mode == CHANNEL_MONITOR_PULSES) || (cmdInput->mode == CHANNEL_HISTOGRAM))) {
+        sendErrorMessage(COMMS_ERROR_INVALID_MODE);
+        return 0;
+    }
+
+    // The frequency counters count their captures with a DMA slot.
+    if((cmdInput->mode == CHANNEL_FREQUENCY) && 
+       !canHWTimerCountFrequency(ch->data.timer.timerHandler)) {
+        sendErrorMessage(COMMS_ERROR_CH_SETT_PARAMS);
+        return 0;
+    }
+
     ch->mode = cmdInput->mode;
     ch->protocol = cmdInput->protocol;
 
@@ -530,6 +1119,222 @@ uint8_t executeChannelSettingsCommand(const ChannelSettingsChannel* cmdInput) {
     return 1;
 }
 
+uint8_t executeExtendedSettingsCommand(const ChannelSettingsExtended* cmdInput) {
+    Channel* ch = getChannelFromNumber(cmdInput->channel);
+
+    if(ch == NULL) {
+        sendErrorMessage(COMMS_ERROR_INVALID_CHANNEL);
+        return 0;
+    }
+
+    if(strncmp(cmdInput->key, COMMS_SETT_EXT_DMA_CAPTURE, sizeof(cmdInput->key)) == 0) {
+        // Only Timer channels can capture with DMA.
+        if(ch->type != CHANNEL_TIMER) {
+            sendErrorMessage(COMMS_ERROR_INVALID_CHANNEL);
+            return 0;
+        }
+
+        if((cmdInput->value != 0) && (cmdInput->value != 1)) {
+            sendErrorMessage(COMMS_ERROR_INVALID_VALUE);
+            return 0;
+        }
+
+        HWTimerChannel* hwTimer = ch->data.timer.timerHandler;
+        setHWTimerEnabled(hwTimer, 0);
+        uint8_t modeSet = setHWTimerCaptureMode(hwTimer, 
+                            cmdInput->value ? HW_TIMER_CAPTURE_DMA : HW_TIMER_CAPTURE_ISR);
+        // Start again with clean buffers.
+        applyChannelConfiguration(ch);
+
+        if(!modeSet) {
+            sendErrorMessage(COMMS_ERROR_CH_SETT_PARAMS);
+            return 0;
+        }
+        return 1;
+    }
+
+    if(strncmp(cmdInput->key, COMMS_SETT_EXT_BUFFER_WEIGHT, sizeof(cmdInput->key)) == 0) {
+        // Only Timer channels store timestamps.
+        if(ch->type != CHANNEL_TIMER) {
+            sendErrorMessage(COMMS_ERROR_INVALID_CHANNEL);
+            return 0;
+        }
+
+        if((cmdInput->value < 1) || (cmdInput->value > UINT8_MAX)) {
+            sendErrorMessage(COMMS_ERROR_INVALID_VALUE);
+            return 0;
+        }
+
+        ch->data.timer.timerHandler->bufferWeight = cmdInput->value;
+        // Redistributes the pool. Start again with clean buffers.
+        applyChannelConfiguration(ch);
+        return 1;
+    }
+
+    if(strncmp(cmdInput->key, COMMS_SETT_EXT_INPUT_FILTER, sizeof(cmdInput->key)) == 0) {
+        if(ch->type != CHANNEL_TIMER) {
+            sendErrorMessage(COMMS_ERROR_INVALID_CHANNEL);
+            return 0;
+        }
+
+        if((cmdInput->value < 0) || (cmdInput->value > COMMS_SETT_EXT_MAX_INPUT_FILTER)) {
+            sendErrorMessage(COMMS_ERROR_INVALID_VALUE);
+            return 0;
+        }
+
+        ch->data.timer.timerHandler->icFilter = cmdInput->value;
+        applyChannelConfiguration(ch);
+        return 1;
+    }
+
+    if(strncmp(cmdInput->key, COMMS_SETT_EXT_PRESCALER, sizeof(cmdInput->key)) == 0) {
+        if(ch->type != CHANNEL_TIMER) {
+            sendErrorMessage(COMMS_ERROR_INVALID_CHANNEL);
+            return 0;
+        }
+
+        uint32_t prescaler;
+        switch(cmdInput->value) {
+            case 1: prescaler = TIM_ICPSC_DIV1; break;
+            case 2: prescaler = TIM_ICPSC_DIV2; break;
+            case 4: prescaler = TIM_ICPSC_DIV4; break;
+            case 8: prescaler = TIM_ICPSC_DIV8; break;
+            default: {
+                sendErrorMessage(COMMS_ERROR_INVALID_VALUE);
+                return 0;
+            }
+        }
+
+        ch->data.timer.timerHandler->icPrescaler = prescaler;
+        applyChannelConfiguration(ch);
+        return 1;
+    }
+
+    if((strncmp(cmdInput->key, COMMS_SETT_EXT_PULSE_PERIOD, sizeof(cmdInput->key)) == 0) ||
+       (strncmp(cmdInput->key, COMMS_SETT_EXT_PULSE_WIDTH, sizeof(cmdInput->key)) == 0)) {
+        if(ch->type != CHANNEL_TIMER) {
+            sendErrorMessage(COMMS_ERROR_INVALID_CHANNEL);
+            return 0;
+        }
+
+        // The edges are placed on whole ticks.
+        uint64_t ticks = convertFromUNIXTimeToInternal(cmdInput->value);
+        if((cmdInput->value <= 0) || 
+           (convertFromInternalToUNIXTime(ticks) != (uint64_t) cmdInput->value)) {
+            sendErrorMessage(COMMS_ERROR_INVALID_VALUE);
+            return 0;
+        }
+
+        HWTimerChannel* hwTimer = ch->data.timer.timerHandler;
+        uint8_t paramsSet;
+        if(cmdInput->key[1] == COMMS_SETT_EXT_PULSE_PERIOD[1]) {
+            paramsSet = setHWTimerPulseParameters(hwTimer, ticks, hwTimer->pulseWidth);
+        }else {
+            paramsSet = setHWTimerPulseParameters(hwTimer, hwTimer->pulsePeriod, ticks);
+        }
+        if(!paramsSet) {
+            sendErrorMessage(COMMS_ERROR_INVALID_VALUE);
+            return 0;
+        }
+
+        // Restart the pulses with the new parameters.
+        if(ch->mode == CHANNEL_PULSE_OUTPUT) applyChannelConfiguration(ch);
+        return 1;
+    }
+
+    if(strncmp(cmdInput->key, COMMS_SETT_EXT_RAW_TIMESTAMPS, sizeof(cmdInput->key)) == 0) {
+        if(ch->type != CHANNEL_TIMER) {
+            sendErrorMessage(COMMS_ERROR_INVALID_CHANNEL);
+            return 0;
+        }
+
+        if((cmdInput->value != 0) && (cmdInput->value != 1)) {
+            sendErrorMessage(COMMS_ERROR_INVALID_VALUE);
+            return 0;
+        }
+
+        setHWTimerRawTimestamps(ch->data.timer.timerHandler, cmdInput->value);
+        // Raw and converted timestamps are not mixed. Start again with clean buffers.
+        applyChannelConfiguration(ch);
+        return 1;
+    }
+
+    if(strncmp(cmdInput->key, COMMS_SETT_EXT_OVERLOAD_RATE, sizeof(cmdInput->key)) == 0) {
+        if(ch->type != CHANNEL_TIMER) {
+            sendErrorMessage(COMMS_ERROR_INVALID_CHANNEL);
+            return 0;
+        }
+
+        if((cmdInput->value < 0) || (cmdInput->value > UINT32_MAX)) {
+            sendErrorMessage(COMMS_ERROR_INVALID_VALUE);
+            return 0;
+        }
+
+        setHWTimerOverloadRate(ch->data.timer.timerHandler, cmdInput->value);
+        return 1;
+    }
+
+    if((strncmp(cmdInput->key, COMMS_SETT_EXT_HISTOGRAM_START, sizeof(cmdInput->key)) == 0) ||
+       (strncmp(cmdInput->key, COMMS_SETT_EXT_HISTOGRAM_WIDTH, sizeof(cmdInput->key)) == 0) ||
+       (strncmp(cmdInput->key, COMMS_SETT_EXT_HISTOGRAM_BINS, sizeof(cmdInput->key)) == 0)) {
+        if(ch->type != CHANNEL_TIMER) {
+            sendErrorMessage(COMMS_ERROR_INVALID_CHANNEL);
+            return 0;
+        }
+
+        HWTimerChannel* hwTimer = ch->data.timer.timerHandler;
+        uint32_t binStart = hwTimer->histogram.binStart;
+        uint32_t binWidth = hwTimer->histogram.binWidth;
+        uint16_t binCount = hwTimer->histogram.binCount;
+        if(cmdInput->key[1] == COMMS_SETT_EXT_HISTOGRAM_BINS[1]) {
+            if((cmdInput->value <= 0) || (cmdInput->value > HW_TIMER_HISTOGRAM_MAX_BINS)) {
+                sendErrorMessage(COMMS_ERROR_INVALID_VALUE);
+                return 0;
+            }
+            binCount = cmdInput->value;
+        }else {
+            // The bins are on whole ticks.
+            uint64_t ticks = convertFromUNIXTimeToInternal(cmdInput->value);
+            if((cmdInput->value < 0) || (ticks > UINT32_MAX) || 
+               (convertFromInternalToUNIXTime(ticks) != (uint64_t) cmdInput->value)) {
+                sendErrorMessage(COMMS_ERROR_INVALID_VALUE);
+                return 0;
+            }
+
+            if(cmdInput->key[1] == COMMS_SETT_EXT_HISTOGRAM_START[1]) {
+                binStart = ticks;
+            }else {
+                binWidth = ticks;
+            }
+        }
+
+        // The counts of the previous bins are lost.
+        if(!setHWTimerHistogramBins(hwTimer, binStart, binWidth, binCount)) {
+            sendErrorMessage(COMMS_ERROR_INVALID_VALUE);
+            return 0;
+        }
+        return 1;
+    }
+
+    if(strncmp(cmdInput->key, COMMS_SETT_EXT_HISTOGRAM_INTERVAL, sizeof(cmdInput->key)) == 0) {
+        if(ch->type != CHANNEL_TIMER) {
+            sendErrorMessage(COMMS_ERROR_INVALID_CHANNEL);
+            return 0;
+        }
+
+        if((cmdInput->value < 0) || (cmdInput->value > UINT32_MAX)) {
+            sendErrorMessage(COMMS_ERROR_INVALID_VALUE);
+            return 0;
+        }
+
+        setHWTimerHistogramInterval(ch->data.timer.timerHandler, cmdInput->value);
+        return 1;
+    }
+
+    sendErrorMessage(COMMS_ERROR_CH_SETT_PARAMS);
+    return 0;
+}
+
 uint8_t executeSyncSettingsCommand(const ChannelSettingsSYNC* cmdInput) {
     if(cmdInput->channel != -1UL) {
         Channel* ch = getChannelFromNumber(cmdInput->channel);
@@ -564,6 +1369,122 @@ uint8_t executeSyncSettingsCommand(const ChannelSettingsSYNC* cmdInput) {
     return 1;
 }
 
+uint8_t executeProfilerCommand(const ChannelProfiler* cmdInput) {
+    if(cmdInput->site >= PROFILER_SITE_COUNT) {
+        sendErrorMessage(COMMS_ERROR_INVALID_VALUE);
+        return 0;
+    }
+
+    if((cmdInput->action != COMMS_PROFILER_READ) && 
+       (cmdInput->action != COMMS_PROFILER_READ_AND_CLEAR)) {
+        sendErrorMessage(COMMS_ERROR_INVALID_VALUE);
+        return 0;
+    }
+
+    ChannelMessage cmdResponse;
+    memcpy(&cmdResponse.profiler, cmdInput, sizeof(ChannelProfiler));
+    return encodeGPIOMessage(GPIO_MSG_PROFILER, cmdResponse);
+}
+
+uint8_t executeLostEdgesCommand(const ChannelLostEdges* cmdInput) {
+    Channel* ch = getChannelFromNumber(cmdInput->channel);
+    if((ch == NULL) || (ch->type != CHANNEL_TIMER)) {
+        sendErrorMessage(COMMS_ERROR_INVALID_CHANNEL);
+        return 0;
+    }
+
+    if((cmdInput->action != COMMS_LOST_EDGES_READ) && 
+       (cmdInput->action != COMMS_LOST_EDGES_READ_AND_CLEAR)) {
+        sendErrorMessage(COMMS_ERROR_INVALID_VALUE);
+        return 0;
+    }
+
+    ChannelMessage cmdResponse;
+    memcpy(&cmdResponse.lostEdges, cmdInput, sizeof(ChannelLostEdges));
+    return encodeGPIOMessage(GPIO_MSG_LOST_EDGES, cmdResponse);
+}
+
+uint8_t executeHistogramCommand(const ChannelHistogram* cmdInput) {
+    Channel* ch = getChannelFromNumber(cmdInput->channel);
+    if((ch == NULL) || (ch->type != CHANNEL_TIMER)) {
+        sendErrorMessage(COMMS_ERROR_INVALID_CHANNEL);
+        return 0;
+    }
+
+    if(ch->mode != CHANNEL_HISTOGRAM) {
+        sendErrorMessage(COMMS_ERROR_INVALID_MODE);
+        return 0;
+    }
+
+    if((cmdInput->action != COMMS_HISTOGRAM_READ) && 
+       (cmdInput->action != COMMS_HISTOGRAM_READ_AND_CLEAR)) {
+        sendErrorMessage(COMMS_ERROR_INVALID_VALUE);
+        return 0;
+    }
+
+    // One message per histogram, so each one fits on the output buffer.
+    ChannelMessage cmdResponse;
+    memcpy(&cmdResponse.histogram, cmdInput, sizeof(ChannelHistogram));
+    uint8_t sent = 1;
+    for(uint8_t kind = 0; kind < HW_TIMER_HISTOGRAM_KIND_COUNT; kind++) {
+        cmdResponse.histogram.kind = kind;
+        sent &= encodeGPIOMessage(GPIO_MSG_HISTOGRAM, cmdResponse);
+    }
+    return sent;
+}
+
+uint8_t executeSyncQualityCommand(const ChannelSyncQuality* cmdInput) {
+    ChannelMessage cmdResponse;
+    memcpy(&cmdResponse.syncQuality, cmdInput, sizeof(ChannelSyncQuality));
+    return encodeGPIOMessage(GPIO_MSG_SYNC_QUALITY, cmdResponse);
+}
+
+uint8_t executeClockStatusCommand(const ChannelClockStatus* cmdInput) {
+    ChannelMessage cmdResponse;
+    memcpy(&cmdResponse.clockStatus, cmdInput, sizeof(ChannelClockStatus));
+    return encodeGPIOMessage(GPIO_MSG_CLOCK_STATUS, cmdResponse);
+}
+
+uint8_t executeCalibrationCommand(const ChannelCalibration* cmdInput) {
+    calibrateHWTimerPhases(&hwTimers);
+
+    ChannelMessage cmdResponse;
+    memcpy(&cmdResponse.calibration, cmdInput, sizeof(ChannelCalibration));
+    return encodeGPIOMessage(GPIO_MSG_CALIBRATION, cmdResponse);
+}
+
+uint8_t executePropagationDelayCommand(const ChannelPropagationDelay* cmdInput) {
+    Channel* ch = getChannelFromNumber(cmdInput->channel);
+    if((ch == NULL) || (ch->type != CHANNEL_TIMER)) {
+        sendErrorMessage(COMMS_ERROR_INVALID_CHANNEL);
+        return 0;
+    }
+
+    if(getProtocolIndex_(cmdInput->protocol) >= CH_PROTOCOL_COUNT) {
+        sendErrorMessage(COMMS_ERROR_INVALID_SIGNAL_TYPE);
+        return 0;
+    }
+
+    if(cmdInput->action == COMMS_DELAY_SET) {
+        // The whole table is written to the flash, which stalls the ISRs of the channels.
+        if(!areHWTimersIdle(&hwTimers)) {
+            sendErrorMessage(COMMS_ERROR_INVALID_MODE);
+            return 0;
+        }
+        if(!setPropagationDelay(cmdInput->channel, cmdInput->protocol, cmdInput->delay)) {
+            sendErrorMessage(COMMS_ERROR_INTERNAL);
+            return 0;
+        }
+    }else if(cmdInput->action != COMMS_DELAY_READ) {
+        sendErrorMessage(COMMS_ERROR_INVALID_VALUE);
+        return 0;
+    }
+
+    ChannelMessage cmdResponse;
+    memcpy(&cmdResponse.propagationDelay, cmdInput, sizeof(ChannelPropagationDelay));
+    return encodeGPIOMessage(GPIO_MSG_PROPAGATION_DELAY, cmdResponse);
+}
+
 void sendErrorMessage(const char* errorMsg) {
     ChannelMessage cmdResponse;
     strcpy((char*) cmdResponse.error.message, errorMsg);
@@ -599,13 +1520,37 @@ void establishConnection(uint8_t connect) {
 }
 
 uint64_t convertFromInternalToUNIXTime(uint64_t tIn) {
+#if MCU_EXACT_TIME_CONVERSION
+    // tIn*NUM/DEN, split so that the product can't overflow. With constant operands (a power of 
+    // two denominator at 160 MHz) it reduces to multiplications and shifts.
+    return (tIn / MCU_TICK_NS_DENOMINATOR)*MCU_TICK_NS_NUMERATOR + 
+           ((tIn % MCU_TICK_NS_DENOMINATOR)*MCU_TICK_NS_NUMERATOR) / MCU_TICK_NS_DENOMINATOR;
+#else
     const double inToOutFactor = 1e9 / ((double) MCU_FREQUENCY);
     return tIn * inToOutFactor;
+#endif
+}
+
+void convertTimestampsToUNIXTime(uint64_t* timestamps, uint32_t count, int32_t delay) {
+    for(uint32_t i = 0; i < count; i++) {
+        uint64_t readVal = timestamps[i];
+        // The LSB is the value of the channel (HIGH or LOW). The rest is the timestamp in internal 
+        // time. Convert to UNIX time the timestamp, remove the propagation delay, shift it to the 
+        // left one bit and add the value of the channel. The gaps are sent as they are.
+        if(readVal & HW_TIMER_GAP_MARKER) continue;
+        uint64_t time = convertFromInternalToUNIXTime(readVal >> 1) - (int64_t) delay;
+        timestamps[i] = (time << 1) | (readVal & 0x01ULL);
+    }
 }
 
 uint64_t convertFromUNIXTimeToInternal(uint64_t tEx) {
+#if MCU_EXACT_TIME_CONVERSION
+    return (tEx / MCU_TICK_NS_NUMERATOR)*MCU_TICK_NS_DENOMINATOR + 
+           ((tEx % MCU_TICK_NS_NUMERATOR)*MCU_TICK_NS_DENOMINATOR) / MCU_TICK_NS_NUMERATOR;
+#else
     const double outToInFactor = ((double) MCU_FREQUENCY) / 1e9;
     return tEx * outToInFactor;
+#endif
 }
 
 uint32_t getChannelNumberFromBuffer(const uint8_t* buf) {
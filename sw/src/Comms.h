@@ -14,7 +14,9 @@
 #define COMMS_h
 
 #include "HWTimers.h"
+#include "Profiler.h"
 #include "CommsProtocol.h"
+#include "ClockManager.h"
 #include "CircularBuffer.h"
 
 #include "usb_device.h"
@@ -79,6 +81,16 @@ uint16_t encodeInput(const ChannelInput* dataStruct, uint8_t* outBuffer);
 ***************************************************************************************************/
 uint16_t encodeMonitor(HWTimerChannel* hwTimer, uint8_t* outBuffer, const uint16_t maxMsgLen);
 
+/**************************************** FUNCTION *************************************************
+ * @brief Encodes the pulses of a monitor pulses HWTimerChannel: each one is its start, as a monitor
+ * timestamp, followed by its width in ticks (uint32). The markers go as pulses of width 0.
+ * @param hwTimer. Pointer to the HWTimerChannel to print.
+ * @param outBuffer: Where the encoded message will be stored.
+ * @param maxMsgLen: Max length of the output buffer.
+ * @return The byte length of the output buffer.
+***************************************************************************************************/
+uint16_t encodePulses(HWTimerChannel* hwTimer, uint8_t* outBuffer, const uint16_t maxMsgLen);
+
 /**************************************** FUNCTION *************************************************
  * @brief Encodes a message to a byte buffer with a given FREQUENCY data structure.
  * @param dataStruct: Where the message fields are stored.
@@ -96,6 +108,83 @@ uint16_t encodeFrequency(const ChannelFrequency* dataStruct, uint8_t* outBuffer)
 ***************************************************************************************************/
 uint16_t encodeError(const ChannelError* dataStruct, uint8_t* outBuffer, const uint16_t maxMsgLen);
 
+/**************************************** FUNCTION *************************************************
+ * @brief Encodes a message to a byte buffer with the statistics of a profiled site.
+ * @param dataStruct: Where the message fields are stored.
+ * @param outBuffer: Where the encoded message will be stored.
+ * @return The byte length of the output buffer.
+***************************************************************************************************/
+uint16_t encodeProfiler(const ChannelProfiler* dataStruct, uint8_t* outBuffer);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Encodes a message to a byte buffer with the lost edges counters of a channel.
+ * @param dataStruct: Where the message fields are stored.
+ * @param outBuffer: Where the encoded message will be stored.
+ * @return The byte length of the output buffer.
+***************************************************************************************************/
+uint16_t encodeLostEdges(const ChannelLostEdges* dataStruct, uint8_t* outBuffer);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Encodes a message to a byte buffer with the status of the SYNC servo.
+ * @param dataStruct: Where the message fields are stored.
+ * @param outBuffer: Where the encoded message will be stored.
+ * @return The byte length of the output buffer.
+***************************************************************************************************/
+uint16_t encodeSyncQuality(const ChannelSyncQuality* dataStruct, uint8_t* outBuffer);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Encodes a message to a byte buffer with the status of the clock of the MCU.
+ * @param dataStruct: Where the message fields are stored.
+ * @param outBuffer: Where the encoded message will be stored.
+ * @return The byte length of the output buffer.
+***************************************************************************************************/
+uint16_t encodeClockStatus(const ChannelClockStatus* dataStruct, uint8_t* outBuffer);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Encodes a message to a byte buffer with the phase offsets of the TIMx.
+ * @param dataStruct: Where the message fields are stored.
+ * @param outBuffer: Where the encoded message will be stored.
+ * @return The byte length of the output buffer.
+***************************************************************************************************/
+uint16_t encodeCalibration(const ChannelCalibration* dataStruct, uint8_t* outBuffer);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Encodes a PROPAGATION DELAY message into a byte buffer. The delay is read from the table.
+ * @param dataStruct: The message to encode.
+ * @param outBuffer: Where the encoded message will be stored.
+ * @return The byte length of the output buffer.
+***************************************************************************************************/
+uint16_t encodePropagationDelay(const ChannelPropagationDelay* dataStruct, uint8_t* outBuffer);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Encodes a TIMEBASE message into a byte buffer: the SYNC record of an epoch and the tick
+ * duration, so the computer can convert the raw timestamps.
+ * @param dataStruct: The message to encode.
+ * @param outBuffer: Where the encoded message will be stored.
+ * @return The byte length of the output buffer, or 0 if the record is gone.
+***************************************************************************************************/
+uint16_t encodeTimebase(const ChannelTimebase* dataStruct, uint8_t* outBuffer);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Encodes a STATISTICS message into a byte buffer: the statistics report of an overloaded 
+ * channel, with its periods in ns.
+ * @param dataStruct: The message to encode.
+ * @param outBuffer: Where the encoded message will be stored.
+ * @return The byte length of the output buffer.
+***************************************************************************************************/
+uint16_t encodeStatistics(const ChannelStatistics* dataStruct, uint8_t* outBuffer);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Encodes a message to a byte buffer with one histogram of a histogram channel, with its 
+ * bins in ns. The histogram is cleared if asked and the message fits.
+ * @param dataStruct: The message to encode.
+ * @param outBuffer: Where the encoded message will be stored.
+ * @param maxMsgLen: Max length of the output buffer.
+ * @return The byte length of the output buffer.
+***************************************************************************************************/
+uint16_t encodeHistogram(const ChannelHistogram* dataStruct, uint8_t* outBuffer, 
+                         const uint16_t maxMsgLen);
+
 /**************************************** FUNCTION *************************************************
  * @brief Decodes an INPUT message coming from a byte buffer.
  * @param outBuffer: Where the raw message is stored.
@@ -128,6 +217,14 @@ uint8_t decodeFrequency(const uint8_t* dataBuffer, ChannelFrequency *decodedMsg)
 ***************************************************************************************************/
 uint8_t decodeSettingsChannel(const uint8_t* dataBuffer, ChannelSettingsChannel *decodedMsg);
 
+/**************************************** FUNCTION *************************************************
+ * @brief Decodes an EXTENDED SETTINGS CHANNEL message coming from a byte buffer.
+ * @param outBuffer: Where the raw message is stored.
+ * @param decodedMsg: Where the decoded message will be stored.
+ * @return 1 if the message was well decoded.
+***************************************************************************************************/
+uint8_t decodeSettingsExtended(const uint8_t* dataBuffer, ChannelSettingsExtended *decodedMsg);
+
 /**************************************** FUNCTION *************************************************
  * @brief Decodes an SETTINGS SYNC message coming from a byte buffer.
  * @param outBuffer: Where the raw message is stored.
@@ -136,6 +233,62 @@ uint8_t decodeSettingsChannel(const uint8_t* dataBuffer, ChannelSettingsChannel
 ***************************************************************************************************/
 uint8_t decodeSettingsSync(const uint8_t* dataBuffer, ChannelSettingsSYNC *decodedMsg);
 
+/**************************************** FUNCTION *************************************************
+ * @brief Decodes a PROFILER message coming from a byte buffer.
+ * @param outBuffer: Where the raw message is stored.
+ * @param decodedMsg: Where the decoded message will be stored.
+ * @return 1 if the message was well decoded.
+***************************************************************************************************/
+uint8_t decodeProfiler(const uint8_t* dataBuffer, ChannelProfiler *decodedMsg);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Decodes a LOST EDGES message coming from a byte buffer.
+ * @param outBuffer: Where the raw message is stored.
+ * @param decodedMsg: Where the decoded message will be stored.
+ * @return 1 if the message was well decoded.
+***************************************************************************************************/
+uint8_t decodeLostEdges(const uint8_t* dataBuffer, ChannelLostEdges *decodedMsg);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Decodes a HISTOGRAM message coming from a byte buffer.
+ * @param outBuffer: Where the raw message is stored.
+ * @param decodedMsg: Where the decoded message will be stored.
+ * @return 1 if the message was well decoded.
+***************************************************************************************************/
+uint8_t decodeHistogram(const uint8_t* dataBuffer, ChannelHistogram *decodedMsg);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Decodes a SYNC QUALITY message coming from a byte buffer.
+ * @param outBuffer: Where the raw message is stored.
+ * @param decodedMsg: Where the decoded message will be stored.
+ * @return 1 if the message was well decoded.
+***************************************************************************************************/
+uint8_t decodeSyncQuality(const uint8_t* dataBuffer, ChannelSyncQuality *decodedMsg);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Decodes a CLOCK STATUS message coming from a byte buffer.
+ * @param outBuffer: Where the raw message is stored.
+ * @param decodedMsg: Where the decoded message will be stored.
+ * @return 1 if the message was well decoded.
+***************************************************************************************************/
+uint8_t decodeClockStatus(const uint8_t* dataBuffer, ChannelClockStatus *decodedMsg);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Decodes a CALIBRATION message coming from a byte buffer.
+ * @param outBuffer: Where the raw message is stored.
+ * @param decodedMsg: Where the decoded message will be stored.
+ * @return 1 if the message was well decoded.
+***************************************************************************************************/
+uint8_t decodeCalibration(const uint8_t* dataBuffer, ChannelCalibration *decodedMsg);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Decodes a PROPAGATION DELAY message coming from a byte buffer.
+ * @param outBuffer: Where the raw message is stored.
+ * @param decodedMsg: Where the decoded message will be stored.
+ * @return 1 if the message was well decoded.
+***************************************************************************************************/
+uint8_t decodePropagationDelay(const uint8_t* dataBuffer, ChannelPropagationDelay *decodedMsg);
+
 #if MCU_TX_IN_ASCII
 /**************************************** FUNCTION *************************************************
  * @brief Converts a uint64_t number into HEX. This number gets written into a string. The written
@@ -176,6 +329,13 @@ uint8_t executeFrequencyCommand(const ChannelFrequency* cmdInput);
 ***************************************************************************************************/
 uint8_t executeChannelSettingsCommand(const ChannelSettingsChannel* cmdInput);
 
+/**************************************** FUNCTION *************************************************
+ * @brief Executes an EXTENDED CHANNEL SETTINGS command.
+ * @param cmdInput: The message/command to execute.
+ * @return 1 if the message was well executed.
+***************************************************************************************************/
+uint8_t executeExtendedSettingsCommand(const ChannelSettingsExtended* cmdInput);
+
 /**************************************** FUNCTION *************************************************
  * @brief Executes a SYNC SETTINGS command.
  * @param cmdInput: The message/command to execute.
@@ -183,6 +343,59 @@ uint8_t executeChannelSettingsCommand(const ChannelSettingsChannel* cmdInput);
 ***************************************************************************************************/
 uint8_t executeSyncSettingsCommand(const ChannelSettingsSYNC* cmdInput);
 
+/**************************************** FUNCTION *************************************************
+ * @brief Executes a PROFILER command: sends the statistics of the site and clears them if asked.
+ * @param cmdInput: The message/command to execute.
+ * @return 1 if the message was well executed.
+***************************************************************************************************/
+uint8_t executeProfilerCommand(const ChannelProfiler* cmdInput);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Executes a LOST EDGES command: sends the lost edges counters of the channel and clears 
+ * them if asked.
+ * @param cmdInput: The message/command to execute.
+ * @return 1 if the message was well executed.
+***************************************************************************************************/
+uint8_t executeLostEdgesCommand(const ChannelLostEdges* cmdInput);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Executes a HISTOGRAM command: sends the histograms of a histogram channel and clears them
+ * if asked.
+ * @param cmdInput: The message/command to execute.
+ * @return 1 if the message was well executed.
+***************************************************************************************************/
+uint8_t executeHistogramCommand(const ChannelHistogram* cmdInput);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Executes a SYNC QUALITY command: sends the status of the SYNC servo.
+ * @param cmdInput: The message/command to execute.
+ * @return 1 if the message was well executed.
+***************************************************************************************************/
+uint8_t executeSyncQualityCommand(const ChannelSyncQuality* cmdInput);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Executes a CLOCK STATUS command: sends the status of the clock of the MCU.
+ * @param cmdInput: The message/command to execute.
+ * @return 1 if the message was well executed.
+***************************************************************************************************/
+uint8_t executeClockStatusCommand(const ChannelClockStatus* cmdInput);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Executes a CALIBRATION command: measures again the phase offsets of the TIMx and sends 
+ * them.
+ * @param cmdInput: The message/command to execute.
+ * @return 1 if the message was well executed.
+***************************************************************************************************/
+uint8_t executeCalibrationCommand(const ChannelCalibration* cmdInput);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Executes a PROPAGATION DELAY command: sets the delay of a channel and protocol if asked,
+ * and returns it.
+ * @param cmdInput: The message/command to execute.
+ * @return 1 if the message was well executed.
+***************************************************************************************************/
+uint8_t executePropagationDelayCommand(const ChannelPropagationDelay* cmdInput);
+
 /**************************************** FUNCTION *************************************************
  * @brief Generates and sends an error message.
  * @param errorMsg: The error message.
@@ -202,6 +415,15 @@ void establishConnection(uint8_t connect);
  ***************************************************************************************************/
 uint64_t convertFromInternalToUNIXTime(uint64_t tIn);
 
+/**************************************** FUNCTION *************************************************
+ * @brief Converts a batch of monitor timestamps (internal time shifted one bit left plus the GPIO 
+ * level on the LSB) to UNIX time in nanoseconds, keeping the level. The gaps are left as they are.
+ * @param timestamps: The timestamps, converted in place.
+ * @param count: Number of timestamps.
+ * @param delay: Propagation delay of the channel in ns, subtracted from the timestamps.
+ ***************************************************************************************************/
+void convertTimestampsToUNIXTime(uint64_t* timestamps, uint32_t count, int32_t delay);
+
 /**************************************** FUNCTION *************************************************
  * @brief Converts from UNIX time in nanoseconds to internal time (increments of the master timer).
  * @param tEx: External time.
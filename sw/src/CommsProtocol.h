@@ -21,8 +21,18 @@
 #define COMMS_MSG_OUTPUT_LEN         13
 #define COMMS_MSG_FREQ_LEN           28
 #define COMMS_MSG_MONITOR_HEADER_LEN 8
+#define COMMS_MSG_PULSES_HEADER_LEN  8
 #define COMMS_MSG_CHANNEL_SETT_LEN   8
 #define COMMS_MSG_SYNC_SETT_LEN      29
+#define COMMS_MSG_CHANNEL_EXT_SETT_LEN 15
+#define COMMS_MSG_PROFILER_LEN       5
+#define COMMS_MSG_LOST_EDGES_LEN     5
+#define COMMS_MSG_SYNC_QUALITY_LEN   5
+#define COMMS_MSG_CLOCK_STATUS_LEN   5
+#define COMMS_MSG_CALIBRATION_LEN    5
+#define COMMS_MSG_PROPAGATION_DELAY_LEN 13
+#define COMMS_MSG_HISTOGRAM_LEN      5
+#define COMMS_MSG_HISTOGRAM_HEADER_LEN 39
 #define COMMS_MSG_CONN_LEN           5
 #define COMMS_MSG_DISC_LEN           5
 
@@ -33,8 +43,19 @@
 #define COMMS_MSG_OUTPUT_HEAD        "O"
 #define COMMS_MSG_FREQ_HEAD          "F"
 #define COMMS_MSG_MONITOR_HEAD       "M"
+#define COMMS_MSG_PULSES_HEAD        "W"
 #define COMMS_MSG_CHANNEL_SETT_HEAD  "SC"
 #define COMMS_MSG_SYNC_SETT_HEAD     "SY"
+#define COMMS_MSG_CHANNEL_EXT_SETT_HEAD "SX"
+#define COMMS_MSG_PROFILER_HEAD      "P"
+#define COMMS_MSG_LOST_EDGES_HEAD    "L"
+#define COMMS_MSG_SYNC_QUALITY_HEAD  "QUAL"
+#define COMMS_MSG_CLOCK_STATUS_HEAD  "CLKS"
+#define COMMS_MSG_CALIBRATION_HEAD   "CALB"
+#define COMMS_MSG_PROPAGATION_DELAY_HEAD "DLAY"
+#define COMMS_MSG_TIMEBASE_HEAD      "TICK"
+#define COMMS_MSG_STATISTICS_HEAD    "CHST"
+#define COMMS_MSG_HISTOGRAM_HEAD     "H"
 #define COMMS_MSG_ERROR_HEAD         "E"
 #define COMMS_MSG_CONNECT_HEAD       "CONN"
 #define COMMS_MSG_DISCONNECT_HEAD    "DISC"
@@ -45,26 +66,84 @@
 // Output channels can set their state.
 #define COMMS_SETT_CH_OUTPUT             "OU"
 // Frequency channels are similar to input channels but they calculate their frequency not by their
-// timestamps but by an internal counter, meaning higher frequencies can be detected. Still not 
-// implemented.
+// timestamps but by counting their edges on the TIMx, meaning higher frequencies can be detected. 
+// Only Timer channels, and without duty cycle.
 #define COMMS_SETT_CH_FREQUENCY          "FR"
+// Pulse output channels output a pulse train (a PPS by default) aligned to the MIDDS time. Only 
+// Timer channels.
+#define COMMS_SETT_CH_PULSE_OUTPUT       "PU"
 // Monitoring channels automatically send their "monitoring messages" containing the timestamp of 
 // their edges and its current state.
 #define COMMS_SETT_CH_MONITOR_RISING     "MR"
 #define COMMS_SETT_CH_MONITOR_FALLING    "MF"
 #define COMMS_SETT_CH_MONITOR_BOTH       "MB"
+// Monitor pulses channels capture both edges like "MB", but send each high pulse as its start and
+// its width. Only Timer channels.
+#define COMMS_SETT_CH_MONITOR_PULSES     "MP"
+// Histogram channels capture both edges, but only bin their periods and widths, which are sent 
+// periodically or on request. Only Timer channels.
+#define COMMS_SETT_CH_HISTOGRAM          "HG"
 // A disabled channel is kept in High-Z.
 #define COMMS_SETT_CH_DISABLED           "DS"
 
+// Keys of the extended channel settings. Each one is followed by an 8 byte value.
+// Capture mode of a Timer channel: 0 = one ISR per edge, 1 = DMA.
+#define COMMS_SETT_EXT_DMA_CAPTURE       "DM"
+// Weight of a Timer channel on the timestamp pool: 1 to 255.
+#define COMMS_SETT_EXT_BUFFER_WEIGHT     "WG"
+// Digital filter of a Timer channel input: 0 (none) to 15. See ICxF on the TIMx reference manual.
+#define COMMS_SETT_EXT_INPUT_FILTER      "FL"
+#define COMMS_SETT_EXT_MAX_INPUT_FILTER  15
+// Capture prescaler of a Timer channel: 1, 2, 4 or 8. Only on monitor rising/falling edges modes.
+#define COMMS_SETT_EXT_PRESCALER         "PS"
+// Period and pulse width of a pulse output Timer channel, in ns. Both must be a whole number of 
+// ticks.
+#define COMMS_SETT_EXT_PULSE_PERIOD      "PP"
+#define COMMS_SETT_EXT_PULSE_WIDTH       "PW"
+// Timestamps of a monitor Timer channel: 0 = MIDDS time in ns, 1 = raw ticks with SYNC tags.
+#define COMMS_SETT_EXT_RAW_TIMESTAMPS    "RW"
+// Resume rate of the overload fallback of a monitor Timer channel, in edges/s. 0 disables it.
+#define COMMS_SETT_EXT_OVERLOAD_RATE     "OL"
+// Bins of the histograms of a Timer channel: start of the first bin and bin width in ns (both a 
+// whole number of ticks), and number of bins.
+#define COMMS_SETT_EXT_HISTOGRAM_START   "HS"
+#define COMMS_SETT_EXT_HISTOGRAM_WIDTH   "HB"
+#define COMMS_SETT_EXT_HISTOGRAM_BINS    "HN"
+// Milliseconds between the histogram reports of a Timer channel. 0 to only send them on request.
+#define COMMS_SETT_EXT_HISTOGRAM_INTERVAL "HI"
+
 #define COMMS_SYNC_MIN_FREQ         00.01
 #define COMMS_SYNC_MAX_FREQ         99.99
 #define COMMS_SYNC_MIN_DUTY_CYCLE   0
 #define COMMS_SYNC_MAX_DUTY_CYCLE   100.0
 
+// Actions of the profiler messages.
+#define COMMS_PROFILER_READ             'R'
+#define COMMS_PROFILER_READ_AND_CLEAR   'C'
+
+// Actions of the lost edges messages.
+#define COMMS_LOST_EDGES_READ           'R'
+#define COMMS_LOST_EDGES_READ_AND_CLEAR 'C'
+
+// Actions of the histogram messages.
+#define COMMS_HISTOGRAM_READ            'R'
+#define COMMS_HISTOGRAM_READ_AND_CLEAR  'C'
+// Identifier of each HWTimerHistogramKind on the histogram messages.
+#define COMMS_HISTOGRAM_KIND_IDS        "PHL"
+
+// Actions of the propagation delay messages.
+#define COMMS_DELAY_READ                'R'
+#define COMMS_DELAY_SET                 'S'
+
 #define COMMS_MAX_TIMESTAMPS_IN_MONITOR 9999
 #define COMMS_MIN_MONITOR_MSG_LEN       16
 // Number of bytes that form a timestamp.
 #define COMMS_MONITOR_TIMESTAMP_LEN     8
+// Timestamps popped and converted at once while encoding a monitor message.
+#define COMMS_MONITOR_BATCH_SIZE        32
+// Number of bytes that form a pulse: its start as a timestamp and its width in ticks.
+#define COMMS_PULSES_RECORD_LEN         12
+#define COMMS_MIN_PULSES_MSG_LEN        20
 
 #define COMMS_ERROR_INVALID_CHANNEL      "RR_INVALID_CHANNEL"
 #define COMMS_ERROR_INVALID_MODE         "RR_INVALID_MODE"
@@ -112,6 +191,9 @@ typedef enum ChannelMode
     CHANNEL_MONITOR_RISING_EDGES,
     CHANNEL_MONITOR_FALLING_EDGES,
     CHANNEL_MONITOR_BOTH_EDGES,
+    CHANNEL_PULSE_OUTPUT,
+    CHANNEL_MONITOR_PULSES,
+    CHANNEL_HISTOGRAM,
     CHANNEL_DISABLED
 } ChannelMode;
 
@@ -157,6 +239,15 @@ typedef struct ChannelSettingsChannel{
     GPIOProtocol    protocol;
 } ChannelSettingsChannel;
 
+// Struct of Settings: extended channel messages.
+typedef struct ChannelSettingsExtended{
+    uint8_t     command;
+    uint8_t     subCommand;
+    uint32_t    channel;
+    char        key[2];
+    int64_t     value;
+} ChannelSettingsExtended;
+
 // Struct of Settings: SYNC messages.
 typedef struct ChannelSettingsSYNC{
     uint8_t     command;
@@ -167,6 +258,65 @@ typedef struct ChannelSettingsSYNC{
     uint64_t    time;
 } ChannelSettingsSYNC;
 
+// Struct of Profiler messages. The statistics are read when encoding the response.
+typedef struct ChannelProfiler{
+    uint8_t     command;
+    uint32_t    site;
+    uint8_t     action;
+} ChannelProfiler;
+
+// Struct of Lost Edges messages. The counters are read when encoding the response.
+typedef struct ChannelLostEdges{
+    uint8_t     command;
+    uint32_t    channel;
+    uint8_t     action;
+} ChannelLostEdges;
+
+// Struct of SYNC Quality messages. The status of the servo is read when encoding the response.
+typedef struct ChannelSyncQuality{
+    uint8_t     command;
+} ChannelSyncQuality;
+
+// Struct of Clock Status messages. The status of the clock is read when encoding the response.
+typedef struct ChannelClockStatus{
+    uint8_t     command;
+} ChannelClockStatus;
+
+// Struct of Calibration messages. The calibration is run when executing the command.
+typedef struct ChannelCalibration{
+    uint8_t     command;
+} ChannelCalibration;
+
+// Struct of Propagation Delay messages.
+typedef struct ChannelPropagationDelay{
+    uint8_t         command;
+    uint32_t        channel;
+    GPIOProtocol    protocol;
+    uint8_t         action;
+    int32_t         delay;
+} ChannelPropagationDelay;
+
+// Struct of Timebase messages, sent by MIDDS alone. The descriptor is read when encoding.
+typedef struct ChannelTimebase{
+    uint8_t     command;
+    uint32_t    epoch;
+} ChannelTimebase;
+
+// Struct of Statistics messages, sent by MIDDS alone while a monitor channel is overloaded.
+typedef struct ChannelStatistics{
+    uint8_t             command;
+    uint32_t            channel;
+    HWTimerStatsReport  report;
+} ChannelStatistics;
+
+// Struct of Histogram messages. The histogram is read when encoding the response.
+typedef struct ChannelHistogram{
+    uint8_t                 command;
+    uint32_t                channel;
+    HWTimerHistogramKind    kind;
+    uint8_t                 action;
+} ChannelHistogram;
+
 // Struct of error messages.
 typedef struct ChannelError{
     uint8_t command;
@@ -181,7 +331,18 @@ typedef enum ChannelMessageType
     GPIO_MSG_FREQUENCY,
     GPIO_MSG_MONITOR,
     GPIO_MSG_CHANNEL_SETTINGS,
+    GPIO_MSG_CHANNEL_EXT_SETTINGS,
     COMMS_MSG_SYNC_SETTINGS,
+    GPIO_MSG_PROFILER,
+    GPIO_MSG_LOST_EDGES,
+    GPIO_MSG_SYNC_QUALITY,
+    GPIO_MSG_CLOCK_STATUS,
+    GPIO_MSG_CALIBRATION,
+    GPIO_MSG_PROPAGATION_DELAY,
+    GPIO_MSG_TIMEBASE,
+    GPIO_MSG_STATISTICS,
+    GPIO_MSG_PULSES,
+    GPIO_MSG_HISTOGRAM,
     GPIO_MSG_ERROR
 } ChannelMessageType;
 
@@ -193,7 +354,17 @@ typedef union ChannelMessage
     ChannelFrequency        frequency;
     HWTimerChannel*         monitor;
     ChannelSettingsChannel  channelSettings;
+    ChannelSettingsExtended extendedSettings;
     ChannelSettingsSYNC     syncSettings;
+    ChannelProfiler         profiler;
+    ChannelLostEdges        lostEdges;
+    ChannelSyncQuality      syncQuality;
+    ChannelClockStatus      clockStatus;
+    ChannelCalibration      calibration;
+    ChannelPropagationDelay propagationDelay;
+    ChannelTimebase         timebase;
+    ChannelStatistics       statistics;
+    ChannelHistogram        histogram;
     ChannelError            error;
 } ChannelMessage;
 
@@ -0,0 +1,74 @@
+/***************************************************************************************************
+ * @file FixedPoint.h
+ * @brief Q48 fixed point arithmetic used by the SYNC corrections.
+ *
+ * Kept free of HAL dependencies so that it can be built and tested on the host (see sw/test).
+ *
+ * @project MIDDS
+ * @version 1.0
+ * @date    2025-08-09
+ * @author  @dabecart
+ *
+ * @license This project is licensed under the MIT License - see the LICENSE file for details.
+***************************************************************************************************/
+
+#ifndef FIXED_POINT_h
+#define FIXED_POINT_h
+
+#include <stdint.h>
+
+// 1.0 in Q48. The SYNC scales are within a few ppm of it, so 2^-48 of resolution keeps their error
+// below a tick for distances of up to 2^48 ticks.
+#define FIXED_POINT_Q48_ONE     (1ULL << 48)
+
+/**************************************** FUNCTION *************************************************
+ * @brief Multiplies a value by a Q48 factor: (value * scaleQ48) >> 48, rounded to the nearest,
+ * without losing the upper bits of the 128-bit product. Exact as long as the result fits in 64
+ * bits.
+ * @param value. The value to scale.
+ * @param scaleQ48. The Q48 factor.
+ * @return The scaled value.
+***************************************************************************************************/
+static inline uint64_t mulQ48(uint64_t value, uint64_t scaleQ48) {
+    // Four 32x32 bit products (UMULL on the Cortex-M4).
+    uint64_t valueHigh = value >> 32, valueLow = (uint32_t) value;
+    uint64_t scaleHigh = scaleQ48 >> 32, scaleLow = (uint32_t) scaleQ48;
+
+    uint64_t lowLow = valueLow * scaleLow;
+    uint64_t lowHigh = valueLow * scaleHigh;
+    uint64_t highLow = valueHigh * scaleLow;
+    // Bits 32 to 63 of the product, plus their carry. Below 3*2^32, so it can't overflow.
+    uint64_t middle = (lowLow >> 32) + (uint32_t) lowHigh + (uint32_t) highLow;
+    uint64_t low = (middle << 32) | (uint32_t) lowLow;
+    uint64_t high = valueHigh * scaleHigh + (lowHigh >> 32) + (highLow >> 32) + (middle >> 32);
+
+    // Half of the last bit, carried to the upper 64 bits if needed.
+    low += 1ULL << 47;
+    if(low < (1ULL << 47)) high++;
+    return (high << 16) | (low >> 48);
+}
+
+/**************************************** FUNCTION *************************************************
+ * @brief Divides two integers into a Q48 ratio: (numerator << 48) / denominator, rounded to the
+ * nearest (half away from zero), without a 128-bit division.
+ * @param numerator. The numerator. The ratio must be below 2^15 in absolute value.
+ * @param denominator. The denominator. Must be between 1 and 2^52.
+ * @return The ratio in Q48.
+***************************************************************************************************/
+static inline int64_t divQ48(int64_t numerator, uint64_t denominator) {
+    uint64_t magnitude = (numerator < 0) ? -(uint64_t) numerator : (uint64_t) numerator;
+
+    // Long division, 12 bits at a time, so that the shifted remainder fits in 64 bits.
+    uint64_t quotient = magnitude / denominator;
+    uint64_t remainder = magnitude % denominator;
+    for(uint8_t i = 0; i < 4; i++) {
+        remainder <<= 12;
+        quotient = (quotient << 12) + remainder / denominator;
+        remainder %= denominator;
+    }
+    if((remainder << 1) >= denominator) quotient++;
+
+    return (numerator < 0) ? -(int64_t) quotient : (int64_t) quotient;
+}
+
+#endif // FIXED_POINT_h
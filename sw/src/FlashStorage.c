@@ -0,0 +1,117 @@
+/***************************************************************************************************
+ * @file FlashStorage.c
+ * @brief Storage of settings that survive a reset, on the last page of the flash.
+ *
+ * @project MIDDS
+ * @version 1.0
+ * @date    2025-08-08
+ * @author  @dabecart
+ *
+ * @license This project is licensed under the MIT License - see the LICENSE file for details.
+***************************************************************************************************/
+
+#include "FlashStorage.h"
+
+#include <string.h>
+
+// Start of the STORAGE region, defined by the linker script.
+extern uint8_t _sstorage[];
+
+uint8_t loadFlashStorage(void* data, uint32_t size) {
+    if(data == NULL) return 0;
+
+    // The page may not be the one written by saveFlashStorage().
+    FLASH_EraseInitTypeDef erase;
+    if(!getFlashStoragePages_(&erase)) return 0;
+
+    const FlashStorageHeader* header = (const FlashStorageHeader*) _sstorage;
+    if((header->magic != FLASH_STORAGE_MAGIC) || (header->size != size)) return 0;
+    if(size > (FLASH_STORAGE_PAGE_SIZE - sizeof(FlashStorageHeader))) return 0;
+
+    const uint8_t* stored = _sstorage + sizeof(FlashStorageHeader);
+    if(getFlashStorageChecksum_(stored, size) != header->checksum) return 0;
+
+    memcpy(data, stored, size);
+    return 1;
+}
+
+uint8_t saveFlashStorage(const void* data, uint32_t size) {
+    if(data == NULL) return 0;
+    if(size > (FLASH_STORAGE_PAGE_SIZE - sizeof(FlashStorageHeader))) return 0;
+
+    FlashStorageHeader header = {
+        .magic = FLASH_STORAGE_MAGIC,
+        .size = size,
+        .checksum = getFlashStorageChecksum_(data, size),
+        .reserved = 0xFFFFFFFFUL,
+    };
+
+    // An erase with the wrong bank mode would hit the firmware instead.
+    FLASH_EraseInitTypeDef erase;
+    if(!getFlashStoragePages_(&erase)) return 0;
+
+    if(HAL_FLASH_Unlock() != HAL_OK) return 0;
+    __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
+
+    uint32_t pageError;
+    uint8_t ok = HAL_FLASHEx_Erase(&erase, &pageError) == HAL_OK;
+
+    // The flash is written in 64-bit words. The last one is padded with the erased value.
+    uint32_t address = (uint32_t) _sstorage;
+    for(uint32_t i = 0; ok && (i < sizeof(header)); i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, (uint8_t*) &header + i, sizeof(word));
+        ok = HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, address + i, word) == HAL_OK;
+    }
+    address += sizeof(header);
+    for(uint32_t i = 0; ok && (i < size); i += sizeof(uint64_t)) {
+        uint64_t word = UINT64_MAX;
+        uint32_t chunk = (size - i) < sizeof(word) ? (size - i) : sizeof(word);
+        memcpy(&word, (const uint8_t*) data + i, chunk);
+        ok = HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, address + i, word) == HAL_OK;
+    }
+
+    HAL_FLASH_Lock();
+
+    return ok && (memcmp(_sstorage + sizeof(header), data, size) == 0);
+}
+
+uint8_t getFlashStoragePages_(FLASH_EraseInitTypeDef* erase) {
+    uint32_t offset = (uint32_t) _sstorage - FLASH_BASE;
+    memset(erase, 0, sizeof(FLASH_EraseInitTypeDef));
+    erase->TypeErase = FLASH_TYPEERASE_PAGES;
+
+    if(!(FLASH->OPTR & FLASH_OPTR_DBANK)) {
+        // A single bank of 4 KB pages.
+        if(((offset % FLASH_PAGE_SIZE_128_BITS) != 0) || 
+           ((offset + FLASH_STORAGE_PAGE_SIZE) > FLASH_SIZE)) {
+            return 0;
+        }
+        erase->Banks = FLASH_BANK_1;
+        erase->Page = offset / FLASH_PAGE_SIZE_128_BITS;
+        erase->NbPages = FLASH_STORAGE_PAGE_SIZE / FLASH_PAGE_SIZE_128_BITS;
+        return 1;
+    }
+
+    // Two banks of 2 KB pages, each one half of the flash. The storage must be in bank 2, whose 
+    // pages are numbered from its own start.
+    uint32_t bankSize = FLASH_SIZE / 2;
+    if((offset < bankSize) || ((offset % FLASH_PAGE_SIZE) != 0) || 
+       ((offset + FLASH_STORAGE_PAGE_SIZE) > FLASH_SIZE)) {
+        return 0;
+    }
+    erase->Banks = FLASH_BANK_2;
+    erase->Page = (offset - bankSize) / FLASH_PAGE_SIZE;
+    erase->NbPages = FLASH_STORAGE_PAGE_SIZE / FLASH_PAGE_SIZE;
+    return 1;
+}
+
+uint32_t getFlashStorageChecksum_(const void* data, uint32_t size) {
+    const uint8_t* bytes = (const uint8_t*) data;
+    uint32_t hash = 2166136261UL;
+    for(uint32_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619UL;
+    }
+    return hash;
+}
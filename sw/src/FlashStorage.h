@@ -0,0 +1,71 @@
+/***************************************************************************************************
+ * @file FlashStorage.h
+ * @brief Storage of settings that survive a reset, on the last page of the flash.
+ *
+ * @project MIDDS
+ * @version 1.0
+ * @date    2025-08-08
+ * @author  @dabecart
+ *
+ * @license This project is licensed under the MIT License - see the LICENSE file for details.
+***************************************************************************************************/
+
+#ifndef FLASH_STORAGE_h
+#define FLASH_STORAGE_h
+
+#include <stdint.h>
+
+#include "stm32g4xx_hal.h"
+
+// Identifies a written storage page. Change it when the layout of the stored data changes, so the
+// old data is not loaded.
+#define FLASH_STORAGE_MAGIC         0x4D445331UL // "MDS1"
+
+// The storage is reserved by the linker script (STORAGE region). With a single bank (DBANK = 0), 
+// it is one 4 KB page. With two banks (DBANK = 1, the factory default), it is two 2 KB pages at 
+// the end of bank 2. The option byte is read before every access.
+#define FLASH_STORAGE_PAGE_SIZE     FLASH_PAGE_SIZE_128_BITS
+
+// Header before the stored data.
+typedef struct FlashStorageHeader {
+    uint32_t    magic;
+    uint32_t    size;       // Bytes of data after the header.
+    uint32_t    checksum;   // FNV-1a of the data.
+    uint32_t    reserved;   // Keeps the data aligned to the 64-bit flash words.
+} FlashStorageHeader;
+
+/**************************************** FUNCTION *************************************************
+ * @brief Copies the stored data if it is valid and has the expected size.
+ * @param data. Where the data will be copied.
+ * @param size. Bytes of data.
+ * @return 1 if the data was loaded. Otherwise, data is left untouched.
+***************************************************************************************************/
+uint8_t loadFlashStorage(void* data, uint32_t size);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Erases the storage page and writes the data on it. The CPU stalls while the flash is 
+ * erased (about 25 ms), and no ISR runs meanwhile (even those running from the CCM SRAM need their 
+ * vectors from the flash). The caller must stop anything that can't wait that long.
+ * @param data. The data to store.
+ * @param size. Bytes of data. Up to FLASH_STORAGE_PAGE_SIZE minus the header.
+ * @return 1 if the data was written and verified.
+***************************************************************************************************/
+uint8_t saveFlashStorage(const void* data, uint32_t size);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Calculates the FNV-1a checksum of a buffer.
+ * @param data. The buffer.
+ * @param size. Bytes of the buffer.
+ * @return The checksum.
+***************************************************************************************************/
+uint32_t getFlashStorageChecksum_(const void* data, uint32_t size);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Finds the flash pages of the storage for the current bank mode (DBANK option bit).
+ * @param erase. Where the bank, first page and number of pages will be stored.
+ * @return 1 if the storage fills whole pages of a single bank. Otherwise, the storage can't be 
+ * used.
+***************************************************************************************************/
+uint8_t getFlashStoragePages_(FLASH_EraseInitTypeDef* erase);
+
+#endif // FLASH_STORAGE_h
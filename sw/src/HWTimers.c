@@ -13,17 +13,51 @@
 #include "HWTimers.h"
 #include "MainMCU.h"
 #include "ChannelController.h"
+#include "Profiler.h"
+#include "FixedPoint.h"
 
-volatile uint64_t coarse = 0;
-volatile uint64_t newCoarse = 0;
-// Time when the sync was measured by the TIMx.
-volatile uint64_t lastSyncMeasured = 0;
-// Time when the sync was supposed to be measured by an ideal TIMx.
-volatile uint64_t lastSyncIdeal = 0;
-volatile uint8_t  currentSyncState = 0xFF;   // 0 = Low, 1 = High, 0xFF = Unknown/Not being used.
-volatile uint8_t  syncPulseCount = 0;
+// The variables used by the ISRs are placed in the CCM SRAM.
+CCM_DATA volatile uint64_t coarse = 0;
+CCM_DATA volatile uint64_t newCoarse = 0;
+// Sequence lock of the coarse. It is odd while the coarse (and the overflow flag of the master 
+// timer) are being changed. The writers are the timer ISRs, which don't preempt each other, or run 
+// with the interrupts disabled, so a reader never waits on an odd value.
+CCM_DATA volatile uint32_t timebaseSequence = 0;
+// Time when the last accepted SYNC edge was measured by the TIMx.
+CCM_DATA volatile uint64_t lastSyncMeasured = 0;
+// Corrected time of a SYNC rising edge. The ideal SYNC edges are found from it.
+CCM_DATA volatile uint64_t syncAnchorIdeal = 0;
+// State of the SYNC servo.
+CCM_DATA volatile HWTimerSyncQuality syncQuality = HW_TIMER_SYNC_UNSYNCHRONIZED;
+// Integral term of the SYNC servo: the estimated ideal ticks/measured ticks, in Q48.
+CCM_DATA volatile int64_t  syncFrequencyQ48 = FIXED_POINT_Q48_ONE;
+// Phase error of the last accepted SYNC edge, in ticks.
+CCM_DATA volatile int64_t  syncPhaseError = 0;
+CCM_DATA volatile uint32_t syncGlitchCount = 0;
+CCM_DATA volatile uint8_t  syncConsecutiveGlitches = 0;
+CCM_DATA volatile uint8_t  syncGoodEdges = 0;
 
-volatile uint64_t newSyncTime = -1;
+CCM_DATA volatile uint64_t newSyncTime = -1;
+
+// SYNC records published by the SYNC ISR. syncEpoch is the index of the current one.
+CCM_BSS HWTimerSyncRecord syncRecords[HW_TIMER_SYNC_HISTORY_SIZE];
+CCM_DATA volatile uint32_t syncEpoch = 0;
+
+// The DMA slots of hwTimers.
+HWTimerDMASlot hwTimerDMASlots[HW_TIMER_DMA_SLOT_COUNT];
+
+// The histogram slots of hwTimers.
+HWTimerHistogramSlot hwTimerHistogramSlots[HW_TIMER_HISTOGRAM_SLOT_COUNT];
+
+// DMA channels assigned to the DMA slots.
+static DMA_Channel_TypeDef* const dmaSlotInstances[HW_TIMER_DMA_SLOT_COUNT] = {
+    DMA2_Channel1, DMA2_Channel2, DMA2_Channel3, DMA2_Channel4,
+    DMA2_Channel5, DMA2_Channel6, DMA2_Channel7, DMA2_Channel8
+};
+static const IRQn_Type dmaSlotIRQs[HW_TIMER_DMA_SLOT_COUNT] = {
+    DMA2_Channel1_IRQn, DMA2_Channel2_IRQn, DMA2_Channel3_IRQn, DMA2_Channel4_IRQn,
+    DMA2_Channel5_IRQn, DMA2_Channel6_IRQn, DMA2_Channel7_IRQn, DMA2_Channel8_IRQn
+};
 
 void initHWTimers(HWTimers* htimers, TIM_HandleTypeDef* htim1, TIM_HandleTypeDef* htim2, 
                   TIM_HandleTypeDef* htim3, TIM_HandleTypeDef* htim4, TIM_HandleTypeDef* htim5)
@@ -36,9 +70,13 @@ void initHWTimers(HWTimers* htimers, TIM_HandleTypeDef* htim1, TIM_HandleTypeDef
     htimers->htim4 = htim4;
     hwTimers.htim5 = htim5;
 
-    // The master time in PROTO MIDDS is the TIM1. The clock of this timer is the same being used 
-    // in all other timers.
+    // The master time in PROTO MIDDS is the TIM1, or the TIM2 on a 32-bit timebase. The clock of 
+    // this timer is the same being used in all other timers.
+#if HW_TIMER_32BIT_TIMEBASE
+    htimers->htimMaster = htim2;
+#else
     htimers->htimMaster = htim1;
+#endif
 
     // vvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvv
     // TIMx initialization
@@ -77,21 +115,88 @@ void initHWTimers(HWTimers* htimers, TIM_HandleTypeDef* htim1, TIM_HandleTypeDef
     initHWTimer_(currentChannel++, htim5, TIM_CHANNEL_2, CH14_GPIO_Port,  CH14_Pin, channelNumber++, 0);
     // Ch 15: TIM5_3
     initHWTimer_(currentChannel++, htim5, TIM_CHANNEL_3, CH15_GPIO_Port,  CH15_Pin, channelNumber++, 0);
+
+    // Link each CCx of each TIMx to its channel so that the ISRs don't have to search for it.
+    memset(htimers->ccChannels, 0, sizeof(htimers->ccChannels));
+    for(uint16_t i = 0; i < HW_TIMER_CHANNEL_COUNT; i++) {
+        HWTimerChannel* timCh = htimers->channels + i;
+        uint8_t timIndex = getHWTimerIndex_(timCh->htim);
+        if(timIndex >= HW_TIMER_TIM_COUNT) continue;
+        htimers->ccChannels[timIndex][timCh->timChannel >> 2] = timCh;
+    }
+
+    // vvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvv
+    // DMA slots initialization
+    // vvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvv
+    __HAL_RCC_DMAMUX1_CLK_ENABLE();
+    __HAL_RCC_DMA2_CLK_ENABLE();
+
+    htimers->dmaSlots = hwTimerDMASlots;
+    htimers->activeDMASlots = 0;
+    for(uint16_t i = 0; i < HW_TIMER_DMA_SLOT_COUNT; i++) {
+        HWTimerDMASlot* slot = htimers->dmaSlots + i;
+        memset(slot, 0, sizeof(HWTimerDMASlot));
+        slot->hdma.Instance = dmaSlotInstances[i];
+        // Same priority as the TIMx, so that the master timer ISR can read the half laps.
+        HAL_NVIC_SetPriority(dmaSlotIRQs[i], 0, 0);
+        HAL_NVIC_EnableIRQ(dmaSlotIRQs[i]);
+    }
+
+    htimers->histogramSlots = hwTimerHistogramSlots;
+    for(uint16_t i = 0; i < HW_TIMER_HISTOGRAM_SLOT_COUNT; i++) {
+        htimers->histogramSlots[i].owner = NULL;
+    }
 }
 
 void initHWTimer_(HWTimerChannel* timCh, TIM_HandleTypeDef* htim, uint32_t timChannel,
                  GPIO_TypeDef* gpioPort, uint32_t gpioPin, uint16_t channelNumber, uint8_t isSync) {
-    init_cb64(&timCh->data, CIRCULAR_BUFFER_64_MAX_SIZE);
+    // The buffer gets its memory when the channel needs it. See distributeHWTimerPool().
+    timCh->needsBuffer = 0;
+    timCh->bufferWeight = HW_TIMER_POOL_DEFAULT_WEIGHT;
+    timCh->rawTimestamps = 0;
+    timCh->isPulseOutput = 0;
+    timCh->pulsePeriod = HW_TIMER_PULSE_DEFAULT_PERIOD;
+    timCh->pulseWidth = HW_TIMER_PULSE_DEFAULT_WIDTH;
+    timCh->isFrequencyCounter = 0;
+    initTimestampBuffer_(timCh, NULL, 0);
+    timCh->droppedCount = 0;
+    timCh->overcaptureCount = 0;
+    timCh->icFilter = 0;
+    timCh->icPrescaler = TIM_ICPSC_DIV1;
     
     timCh->htim = htim;
     timCh->timChannel = timChannel;
     switch (timCh->timChannel) {
-        case TIM_CHANNEL_1: timCh->channelMask = TIM_FLAG_CC1; break;
-        case TIM_CHANNEL_2: timCh->channelMask = TIM_FLAG_CC2; break;
-        case TIM_CHANNEL_3: timCh->channelMask = TIM_FLAG_CC3; break;
-        case TIM_CHANNEL_4: timCh->channelMask = TIM_FLAG_CC4; break;
+        case TIM_CHANNEL_1: 
+            timCh->channelMask = TIM_FLAG_CC1; 
+            timCh->overcaptureMask = TIM_FLAG_CC1OF; 
+            timCh->dmaMask = TIM_DMA_CC1; 
+            break;
+        case TIM_CHANNEL_2: 
+            timCh->channelMask = TIM_FLAG_CC2; 
+            timCh->overcaptureMask = TIM_FLAG_CC2OF; 
+            timCh->dmaMask = TIM_DMA_CC2; 
+            break;
+        case TIM_CHANNEL_3: 
+            timCh->channelMask = TIM_FLAG_CC3; 
+            timCh->overcaptureMask = TIM_FLAG_CC3OF; 
+            timCh->dmaMask = TIM_DMA_CC3; 
+            break;
+        case TIM_CHANNEL_4: 
+            timCh->channelMask = TIM_FLAG_CC4; 
+            timCh->overcaptureMask = TIM_FLAG_CC4OF; 
+            timCh->dmaMask = TIM_DMA_CC4; 
+            break;
         default:    break;
     }
+    timCh->dmaRequest = getHWTimerDMARequest_(htim, timChannel);
+    // TIM_CHANNEL_1-4 go from 0x00 to 0x0C, so they can be used to index the CCRx registers.
+    timCh->ccr = &htim->Instance->CCR1 + (timChannel >> 2);
+#if HW_TIMER_32BIT_TIMEBASE
+    timCh->counterMask = IS_TIM_32B_COUNTER_INSTANCE(htim->Instance) ? 0xFFFFFFFF : 0xFFFF;
+#else
+    timCh->counterMask = 0xFFFF;
+#endif
 
     timCh->gpioPort = gpioPort;
     timCh->gpioPin = gpioPin;
@@ -103,6 +208,47 @@ void initHWTimer_(HWTimerChannel* timCh, TIM_HandleTypeDef* htim, uint32_t timCh
     timCh->lastFrequency = -1.0;
     timCh->lastDutyCycle = -1.0;
     timCh->lastFrequencyCalculationTick = 0;
+    memset(&timCh->edgeStats, 0, sizeof(HWTimerEdgeStats));
+    timCh->statsOnly = 0;
+    timCh->overloadRate = HW_TIMER_OVERLOAD_DEFAULT_RATE;
+    timCh->overloaded = 0;
+    timCh->overloadLostCount = 0;
+    timCh->pendingMarker = 0;
+    timCh->pairPending = 0;
+    timCh->pairTagDeferred = 0;
+    timCh->isHistogram = 0;
+    timCh->histogram.slot = NULL;
+    timCh->histogram.reportInterval = HW_TIMER_HISTOGRAM_DEFAULT_INTERVAL;
+    setHWTimerHistogramBins(timCh, 0, HW_TIMER_HISTOGRAM_DEFAULT_BIN_WIDTH, 
+                            HW_TIMER_HISTOGRAM_DEFAULT_BINS);
+
+    timCh->phaseOffset = 0;
+
+    timCh->captureMode = HW_TIMER_CAPTURE_ISR;
+    timCh->dmaSlot = NULL;
+    timCh->icPolarity = TIM_INPUTCHANNELPOLARITY_BOTHEDGE;
+    timCh->dmaLevel = 0;
+}
+
+uint8_t getHWTimerIndex_(TIM_HandleTypeDef* htim) {
+    if(htim->Instance == TIM1)      return 0;
+    else if(htim->Instance == TIM2) return 1;
+    else if(htim->Instance == TIM3) return 2;
+    else if(htim->Instance == TIM4) return 3;
+    else if(htim->Instance == TIM5) return 4;
+    else                            return HW_TIMER_TIM_COUNT;
+}
+
+uint32_t getHWTimerDMARequest_(TIM_HandleTypeDef* htim, uint32_t timChannel) {
+    // TIM_CHANNEL_1-4 go from 0x00 to 0x0C in steps of four. So do the DMA requests of each TIMx
+    // but in steps of one.
+    uint32_t channelOffset = timChannel >> 2;
+    if(htim->Instance == TIM1)      return DMA_REQUEST_TIM1_CH1 + channelOffset;
+    else if(htim->Instance == TIM2) return DMA_REQUEST_TIM2_CH1 + channelOffset;
+    else if(htim->Instance == TIM3) return DMA_REQUEST_TIM3_CH1 + channelOffset;
+    else if(htim->Instance == TIM4) return DMA_REQUEST_TIM4_CH1 + channelOffset;
+    else if(htim->Instance == TIM5) return DMA_REQUEST_TIM5_CH1 + channelOffset;
+    else                            return 0;
 }
 
 void setSyncParameters(HWTimers* htimers, float frequency, float dutyCycle, 
@@ -116,6 +262,13 @@ void setSyncParameters(HWTimers* htimers, float frequency, float dutyCycle,
     htimers->idealPeriodHighSYNC = MCU_FREQUENCY*dutyCycle/hwTimers.frequencySYNC;
     htimers->idealPeriodLowSYNC  = MCU_FREQUENCY*(1.0 - dutyCycle)/hwTimers.frequencySYNC;
 
+    // An edge can be a quarter of its shortest pulse away from its ideal time. The limit also keeps
+    // the phase error of the servo within 31 bits.
+    uint64_t shortestPulse = htimers->idealPeriodHighSYNC < htimers->idealPeriodLowSYNC ? 
+                             htimers->idealPeriodHighSYNC : htimers->idealPeriodLowSYNC;
+    htimers->maxPhaseErrorSYNC = shortestPulse/4;
+    if(htimers->maxPhaseErrorSYNC > (1ULL << 30)) htimers->maxPhaseErrorSYNC = 1ULL << 30;
+
     // Set all channels as not SYNCs.
     for(int i = 0; i < HW_TIMER_CHANNEL_COUNT; i++) {
         htimers->channels[i].isSYNC = 0;
@@ -123,57 +276,728 @@ void setSyncParameters(HWTimers* htimers, float frequency, float dutyCycle,
 
     if(syncChNumber == -1UL) {
         // Directly set the MIDDS time. By subtracting the current time, we make it so that when the
-        // current TIMx value is added to the coarse, "now" would be "newSyncTime".
-        coarse = requestSyncTime - __HAL_TIM_GET_COUNTER(htimers->htimMaster);
-        newCoarse = coarse + 0x10000ULL;
+        // current TIMx value is added to the coarse, "now" would be "newSyncTime". The master timer
+        // ISR can't run in the middle, or its increment of the coarse would be lost.
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        uint64_t nowTime = readInternalTime_(NULL);
+        timebaseSequence++;
+        coarse += requestSyncTime - nowTime;
+        newCoarse = coarse + HW_TIMER_TIMEBASE_PERIOD;
+        timebaseSequence++;
+        __set_PRIMASK(primask);
     }else {
         Channel* syncCh = getChannelFromNumber(syncChNumber);
         if((syncCh == NULL) || (syncCh->type != CHANNEL_TIMER)) return;
-        syncCh->data.timer.timerHandler->isSYNC = 1;
+        // The SYNC edges must be processed as soon as they arrive, so the SYNC can't be on DMA.
+        HWTimerChannel* syncTimer = syncCh->data.timer.timerHandler;
+        if(syncTimer->captureMode != HW_TIMER_CAPTURE_ISR) {
+            setHWTimerEnabled(syncTimer, 0);
+            setHWTimerCaptureMode(syncTimer, HW_TIMER_CAPTURE_ISR);
+            setHWTimerEnabled(syncTimer, 1);
+        }
+        syncTimer->isSYNC = 1;
         newSyncTime = requestSyncTime;
     }
 
     // Restart the SYNC state.
-    currentSyncState = 0xFF;
-    syncPulseCount = 0;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    syncQuality = HW_TIMER_SYNC_UNSYNCHRONIZED;
+    syncFrequencyQ48 = FIXED_POINT_Q48_ONE;
+    syncPhaseError = 0;
+    syncGlitchCount = 0;
+    syncConsecutiveGlitches = 0;
+    syncGoodEdges = 0;
     lastSyncMeasured = 0;
-    lastSyncIdeal = 0;
+    syncAnchorIdeal = 0;
+    publishSyncRecord_(0, 0, FIXED_POINT_Q48_ONE, 0);
+    __set_PRIMASK(primask);
+
+    // The correction starts over, so the MIDDS time may go back once.
+    htimers->lastInternalTime = UINT64_MAX;
+}
+
+uint8_t setHWTimerPulseParameters(HWTimerChannel* hwTimer, uint64_t period, uint64_t width) {
+    if(hwTimer == NULL) return 0;
+    if((width < HW_TIMER_PULSE_MIN_LENGTH) || (width > period) ||
+       ((period - width) < HW_TIMER_PULSE_MIN_LENGTH)) {
+        return 0;
+    }
+
+    hwTimer->pulsePeriod = period;
+    hwTimer->pulseWidth = width;
+    return 1;
+}
+
+uint8_t startHWTimerPulseOutput(HWTimerChannel* hwTimer) {
+    if((hwTimer == NULL) || hwTimer->isSYNC) return 0;
+
+    // Each edge has to be programmed by the ISR.
+    if(hwTimer->captureMode != HW_TIMER_CAPTURE_ISR) {
+        setHWTimerCaptureMode(hwTimer, HW_TIMER_CAPTURE_ISR);
+    }
+
+    TIM_OC_InitTypeDef sConfigOC = {0};
+    sConfigOC.OCMode = TIM_OCMODE_FORCED_INACTIVE;
+    sConfigOC.OCPolarity = TIM_OCPOLARITY_HIGH;
+    sConfigOC.OCFastMode = TIM_OCFAST_DISABLE;
+    sConfigOC.OCIdleState = TIM_OCIDLESTATE_RESET;
+    if(HAL_TIM_OC_ConfigChannel(hwTimer->htim, &sConfigOC, hwTimer->timChannel) != HAL_OK) {
+        return 0;
+    }
+
+    // The first interrupt comes right away and programs the first edge. The output stays low until
+    // then.
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint64_t now = readInternalTime_(NULL);
+    hwTimer->isPulseOutput = 1;
+    hwTimer->pulseArmed = 0;
+    alignPulseOutput_(hwTimer, now);
+    *hwTimer->ccr = (now + HW_TIMER_PULSE_MIN_LEAD - hwTimer->phaseOffset) & hwTimer->counterMask;
+    setOutputCompareMode_(hwTimer, TIM_OCMODE_TIMING);
+    __HAL_TIM_CLEAR_FLAG(hwTimer->htim, hwTimer->channelMask);
+    HAL_StatusTypeDef status = HAL_TIM_OC_Start_IT(hwTimer->htim, hwTimer->timChannel);
+    __set_PRIMASK(primask);
+
+    return status == HAL_OK;
+}
+
+uint8_t setHWTimerFrequencyCounter(HWTimerChannel* hwTimer, uint8_t enabled) {
+    if((hwTimer == NULL) || hwTimer->isSYNC) return 0;
+
+    HWTimerFrequencyCounter* counter = &hwTimer->frequency;
+    HWTimerDMASlot* slot = hwTimer->dmaSlot;
+    if(!enabled) {
+        if(!hwTimer->isFrequencyCounter) return 1;
+        hwTimer->isFrequencyCounter = 0;
+        if(counter->ownsSlot) {
+            slot->owner = NULL;
+            hwTimer->dmaSlot = NULL;
+            counter->ownsSlot = 0;
+        }else if(slot != NULL) {
+            // Back to streaming the captures into the slot's buffer.
+            slot->hdma.Init.MemInc = DMA_MINC_ENABLE;
+            HAL_DMA_Init(&slot->hdma);
+        }
+        return 1;
+    }
+
+    // Counting the captures on the ISR would take one interrupt every 
+    // HW_TIMER_FREQ_EDGES_PER_CAPTURE edges, so the counter always takes a DMA slot.
+    slot = acquireDMASlot_(hwTimer);
+    if(slot == NULL) return 0;
+    counter->ownsSlot = hwTimer->captureMode != HW_TIMER_CAPTURE_DMA;
+    slot->hdma.Init.MemInc = DMA_MINC_DISABLE;
+    if(HAL_DMA_Init(&slot->hdma) != HAL_OK) {
+        if(counter->ownsSlot) {
+            slot->owner = NULL;
+            hwTimer->dmaSlot = NULL;
+            counter->ownsSlot = 0;
+        }
+        return 0;
+    }
+
+    counter->dmaCapture = 0;
+    counter->captureCount = 0;
+    counter->lastCapture = 0;
+    counter->captureKnown = 0;
+    counter->lastReadTime = 0;
+    counter->gateOpen = 0;
+    hwTimer->lastFrequency = -1.0;
+    hwTimer->lastFrequencyCalculationTick = HAL_GetTick();
+    hwTimer->isFrequencyCounter = 1;
+    return 1;
+}
+
+uint8_t canHWTimerCountFrequency(HWTimerChannel* hwTimer) {
+    if((hwTimer == NULL) || hwTimer->isSYNC || (hwTimer->dmaRequest == 0)) return 0;
+    if(hwTimer->dmaSlot != NULL) return 1;
+
+    for(uint16_t i = 0; i < HW_TIMER_DMA_SLOT_COUNT; i++) {
+        if(hwTimers.dmaSlots[i].owner == NULL) return 1;
+    }
+    return 0;
+}
+
+double getHWTimerCounterFrequency(HWTimerChannel* hwTimer) {
+    if((hwTimer == NULL) || !hwTimer->isFrequencyCounter) return -1.0;
+
+    if((HAL_GetTick() - hwTimer->lastFrequencyCalculationTick) > 
+        HW_TIMER_TICKS_UNTIL_FREQ_RECALCULATE) {
+        return -1.0;
+    }
+    return hwTimer->lastFrequency;
+}
+
+void getSyncStatus(HWTimerSyncStatus* status) {
+    if(status == NULL) return;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    HWTimerSyncRecord* record = syncRecords + (syncEpoch & (HW_TIMER_SYNC_HISTORY_SIZE - 1));
+    status->quality = syncQuality;
+    status->scaleQ48 = record->synchronized ? record->scaleQ48 : FIXED_POINT_Q48_ONE;
+    status->phaseError = syncPhaseError;
+    status->ticksSinceLastSync = (syncQuality == HW_TIMER_SYNC_UNSYNCHRONIZED) ? 0 : 
+                                 readInternalTime_(NULL) - lastSyncMeasured;
+    status->glitchCount = syncGlitchCount;
+    __set_PRIMASK(primask);
 }
 
 void startHWTimers(HWTimers* htimers) {
     if(htimers == NULL) return;
 
-    // Start base timers.
+    // The 32-bit TIMx count on their full width only if the timebase is 32-bit. Otherwise, all TIMx
+    // must wrap at the same time as TIM1.
+#if HW_TIMER_32BIT_TIMEBASE
+    __HAL_TIM_SET_AUTORELOAD(hwTimers.htim2, 0xFFFFFFFF);
+    __HAL_TIM_SET_AUTORELOAD(hwTimers.htim5, 0xFFFFFFFF);
+#else
+    __HAL_TIM_SET_AUTORELOAD(hwTimers.htim2, 0xFFFF);
+    __HAL_TIM_SET_AUTORELOAD(hwTimers.htim5, 0xFFFF);
+#endif
+
+    // Start base timers. The slaves are started first so that, when TIM1 starts, its trigger 
+    // resets all of them at once and they all keep the same count.
+    TIM_HandleTypeDef* slaves[] = {hwTimers.htim2, hwTimers.htim3, hwTimers.htim4, hwTimers.htim5};
+    for(uint16_t i = 0; i < sizeof(slaves)/sizeof(slaves[0]); i++) {
+        HAL_TIM_Base_Start_IT(slaves[i]);
+    }
     HAL_TIM_Base_Start_IT(hwTimers.htim1);
-    // Enable only the Update ISR of the master timer, that's TIM1.
-    HAL_TIM_Base_Start_IT(hwTimers.htim2);
-    __HAL_TIM_DISABLE_IT(hwTimers.htim2, TIM_IT_UPDATE);
-    HAL_TIM_Base_Start_IT(hwTimers.htim3);
-    __HAL_TIM_DISABLE_IT(hwTimers.htim3, TIM_IT_UPDATE);
-    HAL_TIM_Base_Start_IT(hwTimers.htim4);
-    __HAL_TIM_DISABLE_IT(hwTimers.htim4, TIM_IT_UPDATE);
-    HAL_TIM_Base_Start_IT(hwTimers.htim5);
-    __HAL_TIM_DISABLE_IT(hwTimers.htim5, TIM_IT_UPDATE);
+
+    // Enable only the Update ISR of the master timer.
+    TIM_HandleTypeDef* allTimers[] = {hwTimers.htim1, hwTimers.htim2, hwTimers.htim3, 
+                                      hwTimers.htim4, hwTimers.htim5};
+    for(uint16_t i = 0; i < sizeof(allTimers)/sizeof(allTimers[0]); i++) {
+        if(allTimers[i] != hwTimers.htimMaster) {
+            __HAL_TIM_DISABLE_IT(allTimers[i], TIM_IT_UPDATE);
+        }
+    }
 
     // First, start all timers and disable their interrupts.
     for(uint16_t i = 0; i < HW_TIMER_CHANNEL_COUNT; i++) {
         HAL_TIM_IC_Start_IT(hwTimers.channels[i].htim, hwTimers.channels[i].timChannel);
         setHWTimerEnabled(hwTimers.channels + i, 0);
     }
+
+    calibrateHWTimerPhases(htimers);
+}
+
+void calibrateHWTimerPhases(HWTimers* htimers) {
+    if(htimers == NULL) return;
+
+    TIM_HandleTypeDef* allTimers[] = {htimers->htim1, htimers->htim2, htimers->htim3, 
+                                      htimers->htim4, htimers->htim5};
+    for(uint16_t i = 0; i < HW_TIMER_TIM_COUNT; i++) {
+        if(allTimers[i] == htimers->htimMaster) {
+            htimers->phaseOffsets[i] = 0;
+        }else {
+            htimers->phaseOffsets[i] = measureHWTimerPhase_(htimers->htimMaster->Instance, 
+                                                            allTimers[i]->Instance);
+        }
+    }
+
+    for(uint16_t i = 0; i < HW_TIMER_CHANNEL_COUNT; i++) {
+        HWTimerChannel* timCh = htimers->channels + i;
+        uint8_t timIndex = getHWTimerIndex_(timCh->htim);
+        if(timIndex >= HW_TIMER_TIM_COUNT) continue;
+        timCh->phaseOffset = htimers->phaseOffsets[timIndex];
+    }
+}
+
+int32_t measureHWTimerPhase_(TIM_TypeDef* master, TIM_TypeDef* timer) {
+    uint32_t narrowestWindow = UINT32_MAX;
+    int32_t twiceOffset = 0;
+    for(uint16_t i = 0; i < HW_TIMER_PHASE_CALIBRATION_SAMPLES; i++) {
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        uint16_t before = master->CNT;
+        uint16_t count  = timer->CNT;
+        uint16_t after  = master->CNT;
+        __set_PRIMASK(primask);
+
+        // The TIMx was read at the middle of both reads of the timebase.
+        uint32_t window = (uint16_t)(after - before);
+        if(window < narrowestWindow) {
+            narrowestWindow = window;
+            twiceOffset = (int16_t)(before - count) + (int16_t)(after - count);
+        }
+    }
+
+    // Rounded to the nearest tick.
+    return (twiceOffset >= 0) ? ((twiceOffset + 1) / 2) : -((-twiceOffset + 1) / 2);
 }
 
 void clearHWTimer(HWTimerChannel* hwTimer) {
+#if HW_TIMER_COMPACT_TIMESTAMPS
+    // The discarded entries may contain epoch markers, so they have to go through the decoder.
+    uint32_t entryCount = getHWTimerBufferLength(hwTimer);
+    uint64_t timestamp;
+    while(popHWTimerTimestamp(hwTimer, &timestamp, &entryCount));
+#else
     empty_cb64(&hwTimer->data);
+#endif
+    memset(&hwTimer->edgeStats, 0, sizeof(HWTimerEdgeStats));
+    // A new stream starts.
+    hwTimer->overloaded = 0;
+    hwTimer->pendingMarker = 0;
+    hwTimer->overloadLostCount = hwTimer->droppedCount + hwTimer->overcaptureCount;
+    hwTimer->pairPending = 0;
+    hwTimer->pairTagDeferred = 0;
+    clearHWTimerHistogram(hwTimer);
+}
+
+void distributeHWTimerPool(HWTimers* htimers) {
+    uint32_t sizes[HW_TIMER_CHANNEL_COUNT] = {0};
+    uint32_t totalWeight = 0;
+    for(uint16_t i = 0; i < HW_TIMER_CHANNEL_COUNT; i++) {
+        HWTimerChannel* ch = htimers->channels + i;
+        if(ch->needsBuffer) totalWeight += ch->bufferWeight;
+    }
+
+    // First, the share of each channel rounded down to a power of two.
+    uint32_t usedSize = 0;
+    for(uint16_t i = 0; (i < HW_TIMER_CHANNEL_COUNT) && (totalWeight > 0); i++) {
+        HWTimerChannel* ch = htimers->channels + i;
+        if(!ch->needsBuffer) continue;
+
+        uint32_t share = HW_TIMER_POOL_SIZE * ch->bufferWeight / totalWeight;
+        uint32_t size = HW_TIMER_POOL_MIN_CHANNEL_SIZE;
+        while((size << 1) <= share) size <<= 1;
+        sizes[i] = size;
+        usedSize += size;
+    }
+
+    // Rounding down leaves part of the pool unused. Double the buffer of the channel that is 
+    // furthest below its weight, as long as it fits.
+    while(1) {
+        int16_t best = -1;
+        for(uint16_t i = 0; i < HW_TIMER_CHANNEL_COUNT; i++) {
+            if((sizes[i] == 0) || ((usedSize + sizes[i]) > HW_TIMER_POOL_SIZE)) continue;
+            // weight[i]/sizes[i] > weight[best]/sizes[best]
+            if((best < 0) || 
+               (htimers->channels[i].bufferWeight * sizes[best] > 
+                htimers->channels[best].bufferWeight * sizes[i])) {
+                best = i;
+            }
+        }
+        if(best < 0) break;
+        usedSize += sizes[best];
+        sizes[best] <<= 1;
+    }
+
+    // The ISRs push into the buffers, so they can't run while their memory is being changed.
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    HWTimerPoolEntry* storage = htimers->timestampPool;
+    for(uint16_t i = 0; i < HW_TIMER_CHANNEL_COUNT; i++) {
+        HWTimerChannel* ch = htimers->channels + i;
+        HWTimerPoolEntry* newStorage = (sizes[i] > 0) ? storage : NULL;
+        if((ch->data.data != newStorage) || (ch->data.size != sizes[i])) {
+            // The unsent timestamps are lost. If the channel keeps a buffer, they go out as a gap
+            // along the one that was waiting.
+            uint32_t lostCount = countStoredEdges_(ch);
+            uint32_t gap = ch->pendingGap + lostCount;
+            initTimestampBuffer_(ch, newStorage, sizes[i]);
+            ch->droppedCount += lostCount;
+            if(sizes[i] > 0) ch->pendingGap = gap;
+        }
+        storage += sizes[i];
+    }
+    __set_PRIMASK(primask);
+}
+
+uint32_t getHWTimerBufferLength(HWTimerChannel* hwTimer) {
+#if HW_TIMER_COMPACT_TIMESTAMPS
+    return len_cb32(&hwTimer->data);
+#else
+    return len_cb64(&hwTimer->data);
+#endif
+}
+
+uint8_t popHWTimerTimestamp(HWTimerChannel* hwTimer, uint64_t* timestamp, uint32_t* entryCount) {
+    while(popHWTimerRawTimestamp(hwTimer, timestamp, entryCount)) {
+        // The tag has been kept in popSyncTag.
+        if(*timestamp & HW_TIMER_SYNC_TAG_MARKER) continue;
+        if(*timestamp & HW_TIMER_GAP_MARKER) return 1;
+
+        // The LSB is the GPIO level.
+        *timestamp = (applySyncCorrection_(*timestamp >> 1, hwTimer->popSyncTag) << 1) | 
+                     (*timestamp & 0x01ULL);
+        return 1;
+    }
+    return 0;
+}
+
+uint8_t popHWTimerRawTimestamp(HWTimerChannel* hwTimer, uint64_t* timestamp, 
+                               uint32_t* entryCount) {
+    uint64_t raw;
+#if HW_TIMER_COMPACT_TIMESTAMPS
+    uint32_t entry;
+    while(1) {
+        if((*entryCount == 0) || !pop_cb32(&hwTimer->data, &entry)) return 0;
+        (*entryCount)--;
+        if(!(entry & HW_TIMER_EPOCH_MARKER)) {
+            raw = (hwTimer->popEpoch << HW_TIMER_EPOCH_SHIFT) | entry;
+            break;
+        }
+
+        switch(entry & HW_TIMER_ENTRY_TYPE_MASK) {
+            case HW_TIMER_GAP_ENTRY: {
+                *timestamp = HW_TIMER_GAP_MARKER | (entry & HW_TIMER_ENTRY_VALUE_MASK);
+                accumulateGap_(hwTimer, entry & HW_TIMER_ENTRY_VALUE_MASK);
+                return 1;
+            }
+
+            case HW_TIMER_SYNC_ENTRY: {
+                hwTimer->popSyncTag = entry & HW_TIMER_ENTRY_VALUE_MASK;
+                *timestamp = HW_TIMER_SYNC_TAG_MARKER | hwTimer->popSyncTag;
+                return 1;
+            }
+
+            default: {
+                // The marker and its timestamp are published at once, so the second half of the 
+                // marker is always there.
+                uint32_t epochLow;
+                if((*entryCount == 0) || !pop_cb32(&hwTimer->data, &epochLow)) return 0;
+                (*entryCount)--;
+                hwTimer->popEpoch = ((uint64_t)(entry & ~HW_TIMER_EPOCH_MARKER) << 32) | epochLow;
+                break;
+            }
+        }
+    }
+#else
+    while(1) {
+        if((*entryCount == 0) || !pop_cb64(&hwTimer->data, &raw)) return 0;
+        (*entryCount)--;
+        if(raw & HW_TIMER_GAP_MARKER) {
+            *timestamp = raw;
+            accumulateGap_(hwTimer, raw & HW_TIMER_GAP_COUNT_MASK);
+            return 1;
+        }
+        if(raw & HW_TIMER_SYNC_TAG_MARKER) {
+            hwTimer->popSyncTag = raw & HW_TIMER_SYNC_TAG_MASK;
+            *timestamp = raw;
+            return 1;
+        }
+        break;
+    }
+#endif
+
+    accumulateEdge_(hwTimer, raw);
+    *timestamp = raw;
+    return 1;
+}
+
+uint8_t popHWTimerPulse(HWTimerChannel* hwTimer, uint64_t* start, uint32_t* width, 
+                        uint32_t* entryCount) {
+    // The pulse that was waiting has been popped, so the SYNC tag can go now.
+    if(hwTimer->pairTagDeferred && !hwTimer->pairPending) {
+        hwTimer->pairTagDeferred = 0;
+        *start = HW_TIMER_SYNC_TAG_MARKER | hwTimer->popSyncTag;
+        *width = 0;
+        return 1;
+    }
+
+    uint64_t entry;
+    while(popHWTimerRawTimestamp(hwTimer, &entry, entryCount)) {
+        if(entry & HW_TIMER_GAP_MARKER) {
+            // The edges around the gap can't be paired.
+            hwTimer->pairPending = 0;
+            *start = entry;
+            *width = 0;
+            return 1;
+        }
+
+        if(entry & HW_TIMER_SYNC_TAG_MARKER) {
+            // Only the raw starts need the tags. The start of a waiting pulse is on the previous 
+            // SYNC record, so its tag goes after the pulse.
+            if(!hwTimer->rawTimestamps) continue;
+            if(hwTimer->pairPending) {
+                hwTimer->pairTagDeferred = 1;
+                continue;
+            }
+            *start = entry;
+            *width = 0;
+            return 1;
+        }
+
+        // The LSB is the GPIO level after the edge.
+        uint64_t time = entry >> 1;
+        if(entry & 0x01ULL) {
+            // A rising edge without its falling edge (a glitch the filter let through) is replaced.
+            hwTimer->pairPending = 1;
+            hwTimer->pairRising = time;
+            hwTimer->pairRisingTag = hwTimer->popSyncTag;
+            if(hwTimer->pairTagDeferred) {
+                hwTimer->pairTagDeferred = 0;
+                *start = HW_TIMER_SYNC_TAG_MARKER | hwTimer->popSyncTag;
+                *width = 0;
+                return 1;
+            }
+            continue;
+        }
+
+        // A falling edge without its rising edge starts the stream or follows a gap.
+        if(!hwTimer->pairPending) continue;
+        hwTimer->pairPending = 0;
+
+        uint64_t rising = hwTimer->pairRising;
+        if(!hwTimer->rawTimestamps) {
+            rising = applySyncCorrection_(rising, hwTimer->pairRisingTag);
+            time = applySyncCorrection_(time, hwTimer->popSyncTag);
+        }
+        uint64_t ticks = time - rising;
+        *start = (rising << 1) | 0x01ULL;
+        *width = (ticks < UINT32_MAX) ? ticks : UINT32_MAX;
+        return 1;
+    }
+    return 0;
+}
+
+void setHWTimerRawTimestamps(HWTimerChannel* hwTimer, uint8_t raw) {
+    hwTimer->rawTimestamps = raw;
+    // The current SYNC record is described again.
+    hwTimers.descriptorEpoch = syncEpoch - 1;
+}
+
+uint8_t getPendingTimebaseDescriptor(HWTimers* htimers, uint32_t* epoch) {
+    uint32_t currentEpoch = syncEpoch;
+    if(htimers->descriptorEpoch != currentEpoch) {
+        // The records older than the history are gone. Go on from the oldest one left.
+        uint32_t nextEpoch = htimers->descriptorEpoch + 1;
+        if((currentEpoch - nextEpoch) > (HW_TIMER_SYNC_HISTORY_SIZE - 2)) {
+            nextEpoch = currentEpoch - (HW_TIMER_SYNC_HISTORY_SIZE - 2);
+        }
+        *epoch = nextEpoch;
+        return 1;
+    }
+
+    if((HAL_GetTick() - htimers->lastDescriptorTick) >= HW_TIMER_DESCRIPTOR_INTERVAL) {
+        *epoch = currentEpoch;
+        return 1;
+    }
+    return 0;
+}
+
+void setTimebaseDescriptorSent(HWTimers* htimers, uint32_t epoch) {
+    htimers->descriptorEpoch = epoch;
+    htimers->lastDescriptorTick = HAL_GetTick();
+}
+
+uint8_t getTimebaseDescriptor(uint32_t epoch, HWTimerTimebaseDescriptor* descriptor) {
+    if(descriptor == NULL) return 0;
+
+    descriptor->syncTag = epoch & HW_TIMER_SYNC_TAG_MASK;
+    descriptor->internalTime = readInternalTime_(NULL);
+    __DMB();
+    descriptor->record = syncRecords[epoch & (HW_TIMER_SYNC_HISTORY_SIZE - 1)];
+    __DMB();
+
+    // The SYNC ISR may have overwritten the record during the copy. See applySyncCorrection_().
+    return (syncEpoch - epoch) <= (HW_TIMER_SYNC_HISTORY_SIZE - 2);
+}
+
+void getHWTimerLostEdges(HWTimerChannel* hwTimer, uint32_t* droppedCount, 
+                         uint32_t* overcaptureCount, uint8_t clear) {
+    // The ISR may increment the counters in between.
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    *droppedCount = hwTimer->droppedCount;
+    *overcaptureCount = hwTimer->overcaptureCount;
+    if(clear) {
+        hwTimer->droppedCount = 0;
+        hwTimer->overcaptureCount = 0;
+    }
+    __set_PRIMASK(primask);
 }
 
 uint8_t readyToPrintHWTimer(HWTimerChannel* hwTimer) {
-    return (hwTimer->data.len > 0) && (
+    // The markers go out right away. While overloaded, the timestamps only feed the statistics.
+    if(hwTimer->pendingMarker != 0) return 1;
+    if(hwTimer->overloaded) return 0;
+
+    uint32_t len = getHWTimerBufferLength(hwTimer);
+    return (len > 0) && (
                 ((HAL_GetTick() - hwTimer->lastPrintTick) >= MCU_CHANNEL_PRINT_INTERVAL) ||
-                (hwTimer->data.len >= CIRCULAR_BUFFER_64_MAX_SIZE/2)
+                (len >= hwTimer->data.size/2)
             );
 }
 
+void setHWTimerOverloadRate(HWTimerChannel* hwTimer, uint32_t rate) {
+    hwTimer->overloadRate = rate;
+    if((rate == 0) && hwTimer->overloaded) {
+        hwTimer->overloaded = 0;
+        hwTimer->pendingMarker = HW_TIMER_OVERLOAD_MARKER | hwTimer->overloadEdgeCount;
+    }
+}
+
+void processHWTimerOverload(HWTimerChannel* hwTimer) {
+    if((hwTimer->overloadRate == 0) || (hwTimer->data.size == 0)) return;
+
+    if(!hwTimer->overloaded) {
+        uint32_t lostCount = hwTimer->droppedCount + hwTimer->overcaptureCount;
+        uint8_t isLosing = lostCount != hwTimer->overloadLostCount;
+        hwTimer->overloadLostCount = lostCount;
+        if(!isLosing && (getHWTimerBufferLength(hwTimer) < (hwTimer->data.size/4)*3)) return;
+
+        // The timestamps already sent are followed by the marker and then by the statistics.
+        hwTimer->overloaded = 1;
+        hwTimer->pendingMarker = HW_TIMER_OVERLOAD_MARKER | HW_TIMER_OVERLOAD_START;
+        hwTimer->overloadEdgeCount = 0;
+        hwTimer->overloadReportTick = HAL_GetTick();
+        memset(&hwTimer->edgeStats.report, 0, sizeof(HWTimerStatsWindow));
+        // The summarized edges can't be paired.
+        hwTimer->pairPending = 0;
+    }
+
+    uint32_t entryCount = getHWTimerBufferLength(hwTimer);
+    uint64_t timestamp;
+    while(popHWTimerRawTimestamp(hwTimer, &timestamp, &entryCount));
+}
+
+uint8_t getHWTimerOverloadReport(HWTimerChannel* hwTimer, HWTimerStatsReport* report) {
+    if(!hwTimer->overloaded) return 0;
+
+    uint32_t elapsed = HAL_GetTick() - hwTimer->overloadReportTick;
+    if(elapsed < HW_TIMER_OVERLOAD_REPORT_INTERVAL) return 0;
+
+    HWTimerStatsWindow* window = &hwTimer->edgeStats.report;
+    report->edgeCount = window->edgeCount;
+    report->cycleCount = window->cycleCount;
+    if(window->cycleCount > 0) {
+        report->minPeriod = window->minPeriod;
+        report->maxPeriod = window->maxPeriod;
+        report->meanPeriod = window->periodSum / window->cycleCount;
+    }else {
+        report->minPeriod = 0;
+        report->maxPeriod = 0;
+        report->meanPeriod = 0;
+    }
+    if(window->highPeriodSum > 0) {
+        report->dutyCycle = window->highSum * 100.0 / window->highPeriodSum;
+    }else {
+        report->dutyCycle = -1.0;
+    }
+    hwTimer->overloadEdgeCount += window->edgeCount;
+
+    uint32_t lostCount = hwTimer->droppedCount + hwTimer->overcaptureCount;
+    if((lostCount == hwTimer->overloadLostCount) && 
+       (((uint64_t) window->edgeCount * 1000) < ((uint64_t) hwTimer->overloadRate * elapsed))) {
+        // The summarized edges are followed by the marker and then by the timestamps.
+        hwTimer->overloaded = 0;
+        hwTimer->pendingMarker = HW_TIMER_OVERLOAD_MARKER | hwTimer->overloadEdgeCount;
+    }
+    hwTimer->overloadLostCount = lostCount;
+
+    memset(window, 0, sizeof(HWTimerStatsWindow));
+    hwTimer->overloadReportTick += elapsed;
+    return 1;
+}
+
+uint8_t setHWTimerHistogramEnabled(HWTimerChannel* hwTimer, uint8_t enabled) {
+    HWTimerHistogram* histogram = &hwTimer->histogram;
+    if(!enabled) {
+        hwTimer->isHistogram = 0;
+        if(histogram->slot != NULL) histogram->slot->owner = NULL;
+        histogram->slot = NULL;
+        return 1;
+    }
+
+    // Search for a free histogram slot.
+    if(histogram->slot == NULL) {
+        for(uint16_t i = 0; i < HW_TIMER_HISTOGRAM_SLOT_COUNT; i++) {
+            if(hwTimers.histogramSlots[i].owner == NULL) {
+                histogram->slot = hwTimers.histogramSlots + i;
+                break;
+            }
+        }
+        if(histogram->slot == NULL) return 0;
+        histogram->slot->owner = hwTimer;
+    }
+
+    hwTimer->isHistogram = 1;
+    clearHWTimerHistogram(hwTimer);
+    return 1;
+}
+
+uint8_t setHWTimerHistogramBins(HWTimerChannel* hwTimer, uint32_t binStart, uint32_t binWidth,
+                                uint16_t binCount) {
+    if((binWidth == 0) || (binCount == 0) || (binCount > HW_TIMER_HISTOGRAM_MAX_BINS) ||
+       (((uint64_t) binWidth * binCount) > UINT32_MAX)) {
+        return 0;
+    }
+
+    HWTimerHistogram* histogram = &hwTimer->histogram;
+    histogram->binStart = binStart;
+    histogram->binWidth = binWidth;
+    histogram->binCount = binCount;
+    histogram->range = binWidth * binCount;
+    clearHWTimerHistogram(hwTimer);
+    return 1;
+}
+
+void setHWTimerHistogramInterval(HWTimerChannel* hwTimer, uint32_t interval) {
+    hwTimer->histogram.reportInterval = interval;
+    hwTimer->histogram.reportTick = HAL_GetTick();
+}
+
+void clearHWTimerHistogram(HWTimerChannel* hwTimer) {
+    for(uint8_t kind = 0; kind < HW_TIMER_HISTOGRAM_KIND_COUNT; kind++) {
+        clearHWTimerHistogramKind(hwTimer, kind);
+    }
+    hwTimer->histogram.pendingKinds = 0;
+    hwTimer->histogram.reportTick = HAL_GetTick();
+}
+
+void clearHWTimerHistogramKind(HWTimerChannel* hwTimer, HWTimerHistogramKind kind) {
+    HWTimerHistogram* histogram = &hwTimer->histogram;
+    histogram->underflow[kind] = 0;
+    histogram->overflow[kind] = 0;
+    if(histogram->slot == NULL) return;
+    memset(histogram->slot->bins[kind], 0, sizeof(histogram->slot->bins[kind]));
+}
+
+uint8_t getPendingHWTimerHistogram(HWTimerChannel* hwTimer, HWTimerHistogramKind* kind) {
+    HWTimerHistogram* histogram = &hwTimer->histogram;
+    uint32_t elapsed = HAL_GetTick() - histogram->reportTick;
+    if((histogram->pendingKinds == 0) && (histogram->reportInterval != 0) &&
+       (elapsed >= histogram->reportInterval)) {
+        histogram->pendingKinds = (1U << HW_TIMER_HISTOGRAM_KIND_COUNT) - 1;
+        histogram->reportTick += elapsed;
+    }
+    if(histogram->pendingKinds == 0) return 0;
+
+    // The lowest kind goes first.
+    uint8_t next = 0;
+    while(!(histogram->pendingKinds & (1U << next))) next++;
+    *kind = next;
+    return 1;
+}
+
+void setHWTimerHistogramSent(HWTimerChannel* hwTimer, HWTimerHistogramKind kind) {
+    hwTimer->histogram.pendingKinds &= ~(1U << kind);
+}
+
 void setHWTimerEnabled(HWTimerChannel* hwTimer, uint8_t enabled){
+    if(hwTimer->isFrequencyCounter) {
+        setFrequencyCounterEnabled_(hwTimer, enabled);
+        return;
+    }
+
+    if(hwTimer->captureMode == HW_TIMER_CAPTURE_DMA) {
+        // The captures are moved by the DMA, never by the ISR.
+        __HAL_TIM_DISABLE_IT(hwTimer->htim, hwTimer->channelMask);
+        if(enabled) {
+            startHWTimerDMA_(hwTimer);
+        }else {
+            stopHWTimerDMA_(hwTimer);
+        }
+        return;
+    }
+
     if(enabled) {
         __HAL_TIM_ENABLE_IT(hwTimer->htim, hwTimer->channelMask);
     }else {
@@ -181,10 +1005,510 @@ void setHWTimerEnabled(HWTimerChannel* hwTimer, uint8_t enabled){
     }
 }
 
+uint8_t setHWTimerCaptureMode(HWTimerChannel* hwTimer, HWTimerCaptureMode mode) {
+    if(hwTimer == NULL) return 0;
+    if(hwTimer->captureMode == mode) return 1;
+
+    if(mode == HW_TIMER_CAPTURE_ISR) {
+        stopHWTimerDMA_(hwTimer);
+        if(hwTimer->isFrequencyCounter) {
+            // The counter keeps the slot until it is disabled.
+            hwTimer->frequency.ownsSlot = 1;
+        }else {
+            hwTimer->dmaSlot->owner = NULL;
+            hwTimer->dmaSlot = NULL;
+        }
+        hwTimer->captureMode = HW_TIMER_CAPTURE_ISR;
+        return 1;
+    }
+
+    if(hwTimer->isSYNC || (hwTimer->dmaRequest == 0)) return 0;
+#if HW_TIMER_32BIT_TIMEBASE
+    // There are no snapshots of the DMA on every 16-bit overflow, so only the 32-bit captures can 
+    // be extended by the main loop.
+    if(hwTimer->counterMask != 0xFFFFFFFF) return 0;
+#endif
+
+    // A frequency counter may already have a slot of its own.
+    if(acquireDMASlot_(hwTimer) == NULL) return 0;
+    hwTimer->frequency.ownsSlot = 0;
+    hwTimer->captureMode = HW_TIMER_CAPTURE_DMA;
+    return 1;
+}
+
+HWTimerDMASlot* acquireDMASlot_(HWTimerChannel* hwTimer) {
+    if(hwTimer->dmaSlot != NULL) return hwTimer->dmaSlot;
+    if(hwTimer->isSYNC || (hwTimer->dmaRequest == 0)) return NULL;
+
+    // Search for a free DMA slot.
+    HWTimerDMASlot* slot = NULL;
+    for(uint16_t i = 0; i < HW_TIMER_DMA_SLOT_COUNT; i++) {
+        if(hwTimers.dmaSlots[i].owner == NULL) {
+            slot = hwTimers.dmaSlots + i;
+            break;
+        }
+    }
+    if(slot == NULL) return NULL;
+
+    slot->hdma.Init.Request = hwTimer->dmaRequest;
+    slot->hdma.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    slot->hdma.Init.PeriphInc = DMA_PINC_DISABLE;
+    slot->hdma.Init.MemInc = DMA_MINC_ENABLE;
+    slot->hdma.Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
+    slot->hdma.Init.MemDataAlignment = DMA_MDATAALIGN_WORD;
+    slot->hdma.Init.Mode = DMA_CIRCULAR;
+    slot->hdma.Init.Priority = DMA_PRIORITY_VERY_HIGH;
+    if(HAL_DMA_Init(&slot->hdma) != HAL_OK) return NULL;
+
+    slot->owner = hwTimer;
+    hwTimer->dmaSlot = slot;
+    return slot;
+}
+
+void startHWTimerDMA_(HWTimerChannel* hwTimer) {
+    HWTimerDMASlot* slot = hwTimer->dmaSlot;
+    if(slot == NULL) return;
+
+    stopHWTimerDMA_(hwTimer);
+
+    slot->writeCount = 0;
+    slot->readCount = 0;
+    slot->snapshotHead = 0;
+    slot->snapshotTail = 0;
+    slot->overrun = 0;
+    slot->firstOfPeriod = 1;
+    slot->oldCount = 0;
+    slot->ambiguousCount = 0;
+
+    // The DMA only moves the captured value, the GPIO level is deduced from the polarity. On both
+    // edges, the first capture will be the opposite of the current level.
+    hwTimer->dmaLevel = (hwTimer->gpioPort->IDR & hwTimer->gpioPin) != 0;
+
+    if(!startDMASlot_(slot, (uint32_t) hwTimer->ccr, (uint32_t) slot->buffer, 
+                      HW_TIMER_DMA_BUFFER_SIZE)) {
+        return;
+    }
+
+    // The captures are done from now on, so the master timer bounds the raw values of the old 
+    // period of the first snapshot. The snapshots start along the requests, so that no overflow is
+    // left without its snapshot.
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    slot->lastCounter = __HAL_TIM_GET_COUNTER(hwTimers.htimMaster);
+    __HAL_TIM_ENABLE_DMA(hwTimer->htim, hwTimer->dmaMask);
+    hwTimers.activeDMASlots |= 1UL << (slot - hwTimers.dmaSlots);
+    __set_PRIMASK(primask);
+}
+
+void stopHWTimerDMA_(HWTimerChannel* hwTimer) {
+    HWTimerDMASlot* slot = hwTimer->dmaSlot;
+    if(slot == NULL) return;
+
+    __HAL_TIM_DISABLE_DMA(hwTimer->htim, hwTimer->dmaMask);
+    hwTimers.activeDMASlots &= ~(1UL << (slot - hwTimers.dmaSlots));
+    HAL_DMA_Abort(&slot->hdma);
+}
+
+uint8_t startDMASlot_(HWTimerDMASlot* slot, uint32_t source, uint32_t destination, 
+                      uint32_t length) {
+    slot->length = length;
+    slot->halfLaps = 0;
+    if(HAL_DMA_Start(&slot->hdma, source, destination, length) != HAL_OK) return 0;
+
+    // No request has come yet, so the channel can be stopped to enable its interrupts.
+    __HAL_DMA_DISABLE(&slot->hdma);
+    __HAL_DMA_ENABLE_IT(&slot->hdma, DMA_IT_HT | DMA_IT_TC);
+    __HAL_DMA_ENABLE(&slot->hdma);
+    return 1;
+}
+
+CCM_CODE uint32_t updateDMAWriteCount_(HWTimerDMASlot* slot) {
+    DMA_HandleTypeDef* hdma = &slot->hdma;
+    uint32_t flagMask = (DMA_FLAG_HT1 | DMA_FLAG_TC1) << (hdma->ChannelIndex & 0x1FU);
+
+    // A half lap may end while reading the counter. Read again until its flags don't change, so
+    // that the counter and the flags agree.
+    uint32_t flags, remaining;
+    do {
+        flags = hdma->DmaBaseAddress->ISR & flagMask;
+        remaining = __HAL_DMA_GET_COUNTER(hdma);
+    }while(flags != (hdma->DmaBaseAddress->ISR & flagMask));
+
+    // The half laps whose interrupt is still pending are counted here.
+    if(flags != 0) {
+        hdma->DmaBaseAddress->IFCR = flags;
+        slot->halfLaps += __builtin_popcount(flags);
+    }
+
+    uint32_t halfLength = slot->length / 2;
+    uint32_t writeCount = slot->halfLaps*halfLength + ((slot->length - remaining) % halfLength);
+    // Never goes back, in case the counter was read just before its flag got set.
+    if((int32_t)(writeCount - slot->writeCount) > 0) slot->writeCount = writeCount;
+    return slot->writeCount;
+}
+
+CCM_CODE void dmaSlotISR_(uint8_t slotIndex) {
+    HWTimerDMASlot* slot = hwTimers.dmaSlots + slotIndex;
+    DMA_HandleTypeDef* hdma = &slot->hdma;
+    uint32_t flags = hdma->DmaBaseAddress->ISR & 
+                     ((DMA_FLAG_HT1 | DMA_FLAG_TC1) << (hdma->ChannelIndex & 0x1FU));
+    if(flags == 0) return;
+
+    hdma->DmaBaseAddress->IFCR = flags;
+    slot->halfLaps += __builtin_popcount(flags);
+}
+
+uint8_t areHWTimersIdle(HWTimers* htimers) {
+    for(uint16_t i = 0; i < HW_TIMER_CHANNEL_COUNT; i++) {
+        HWTimerChannel* channel = htimers->channels + i;
+        if(channel->htim->Instance->DIER & (channel->channelMask | channel->dmaMask)) return 0;
+    }
+    return 1;
+}
+
+void markHWTimersClockGap(HWTimers* htimers) {
+    // Only a counter, as the NMI may preempt the producers while they clear their pendingGap. Each
+    // producer turns it into a gap on its next push. See pushTimestamp_().
+    htimers->clockGaps++;
+}
+
+void startHWTimebaseStall(HWTimers* htimers) {
+#if !HW_TIMER_32BIT_TIMEBASE
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    htimers->stallStartTime = readInternalTime_(NULL);
+    htimers->stallStartCycles = DWT->CYCCNT;
+    __set_PRIMASK(primask);
+#else
+    (void) htimers;
+#endif
+}
+
+void endHWTimebaseStall(HWTimers* htimers) {
+#if !HW_TIMER_32BIT_TIMEBASE
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint64_t expected = htimers->stallStartTime + (DWT->CYCCNT - htimers->stallStartCycles);
+    uint64_t now = readInternalTime_(NULL);
+    if(expected > now) {
+        // Whole periods, as the counter itself kept running.
+        uint64_t lostOverflows = (expected - now + HW_TIMER_TIMEBASE_PERIOD/2) / 
+                                 HW_TIMER_TIMEBASE_PERIOD;
+        timebaseSequence++;
+        coarse += lostOverflows*HW_TIMER_TIMEBASE_PERIOD;
+        newCoarse = coarse + HW_TIMER_TIMEBASE_PERIOD;
+        timebaseSequence++;
+    }
+    __set_PRIMASK(primask);
+#else
+    (void) htimers;
+#endif
+}
+
+void processHWTimers(HWTimers* htimers) {
+    uint32_t activeSlots = htimers->activeDMASlots;
+    for(uint16_t i = 0; i < HW_TIMER_DMA_SLOT_COUNT; i++) {
+        if(activeSlots & (1UL << i)) {
+            mergeDMASlot_(htimers->dmaSlots + i);
+        }
+    }
+
+    for(uint16_t i = 0; i < HW_TIMER_TIM_COUNT; i++) {
+        for(uint16_t j = 0; j < HW_TIMER_CHANNELS_PER_TIM; j++) {
+            HWTimerChannel* channel = htimers->ccChannels[i][j];
+            if(channel == NULL) continue;
+
+            if(channel->isFrequencyCounter) {
+                updateFrequencyCounter_(channel);
+            }else if(channel->statsOnly) {
+                // Nobody else reads these timestamps. Feed them to the edge statistics.
+                uint32_t entryCount = getHWTimerBufferLength(channel);
+                uint64_t timestamp;
+                while(popHWTimerRawTimestamp(channel, &timestamp, &entryCount));
+            }
+        }
+    }
+
+    checkSyncHoldover_();
+}
+
+void checkSyncHoldover_() {
+    if((syncQuality != HW_TIMER_SYNC_ACQUIRING) && (syncQuality != HW_TIMER_SYNC_LOCKED)) return;
+
+    uint64_t timeout = HW_TIMER_SYNC_HOLDOVER_PERIODS*
+                       (hwTimers.idealPeriodHighSYNC + hwTimers.idealPeriodLowSYNC);
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    // The SYNC ISR may have changed the state since the first check.
+    if(((syncQuality == HW_TIMER_SYNC_ACQUIRING) || (syncQuality == HW_TIMER_SYNC_LOCKED)) &&
+       ((readInternalTime_(NULL) - lastSyncMeasured) > timeout)) {
+        // The last record keeps being applied, extrapolated with the frequency of the servo.
+        syncQuality = HW_TIMER_SYNC_HOLDOVER;
+        syncGoodEdges = 0;
+    }
+    __set_PRIMASK(primask);
+}
+
+void setFrequencyCounterEnabled_(HWTimerChannel* hwTimer, uint8_t enabled) {
+    HWTimerFrequencyCounter* counter = &hwTimer->frequency;
+    HWTimerDMASlot* slot = hwTimer->dmaSlot;
+
+    // The captures are counted by the DMA, never by the ISR.
+    __HAL_TIM_DISABLE_IT(hwTimer->htim, hwTimer->channelMask);
+    if(slot == NULL) return;
+
+    __HAL_TIM_DISABLE_DMA(hwTimer->htim, hwTimer->dmaMask);
+    HAL_DMA_Abort(&slot->hdma);
+    if(!enabled) return;
+
+    // The count starts again, so does the gate. All captures will come after this read.
+    slot->writeCount = 0;
+    counter->captureCount = 0;
+    counter->captureKnown = 0;
+    counter->gateOpen = 0;
+    counter->lastReadTime = readInternalTime_(NULL);
+    if(!startDMASlot_(slot, (uint32_t) hwTimer->ccr, (uint32_t) &counter->dmaCapture, 
+                      HW_TIMER_FREQ_DMA_LENGTH)) {
+        return;
+    }
+    __HAL_TIM_ENABLE_DMA(hwTimer->htim, hwTimer->dmaMask);
+}
+
+uint8_t readFrequencyCounter_(HWTimerChannel* hwTimer, uint32_t* count, uint64_t* capture) {
+    HWTimerFrequencyCounter* counter = &hwTimer->frequency;
+    HWTimerDMASlot* slot = hwTimer->dmaSlot;
+    if(slot == NULL) return 0;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    // The DMA writes the capture before the transfer is counted. If the count is the same before
+    // and after reading the capture, both belong together.
+    uint32_t writeCount, raw;
+    do {
+        writeCount = updateDMAWriteCount_(slot);
+        raw = counter->dmaCapture;
+    }while(writeCount != updateDMAWriteCount_(slot));
+    uint32_t now;
+    uint64_t nowTime = readInternalTime_(&now);
+
+    // Nobody else reads the overcapture flag while the DMA moves the captures.
+    if(hwTimer->htim->Instance->SR & hwTimer->overcaptureMask) {
+        __HAL_TIM_CLEAR_FLAG(hwTimer->htim, hwTimer->overcaptureMask);
+        hwTimer->overcaptureCount++;
+    }
+    __set_PRIMASK(primask);
+
+    if(writeCount != counter->captureCount) {
+        // The last capture came after the previous read. If that read is less than a period of the
+        // TIMx old, so is the capture, and it can be extended with the timebase.
+        if((nowTime - counter->lastReadTime) < 
+           (uint64_t) hwTimer->counterMask - HW_TIMER_FREQ_READ_MARGIN) {
+            counter->lastCapture = nowTime - ((now - raw) & hwTimer->counterMask) + 
+                                   hwTimer->phaseOffset;
+            counter->captureKnown = 1;
+        }else {
+            // The time of the last capture is lost, and so is the gate.
+            counter->gateOpen = 0;
+            counter->captureKnown = 0;
+        }
+        counter->captureCount = writeCount;
+    }
+    counter->lastReadTime = nowTime;
+
+    *count = counter->captureCount;
+    *capture = counter->lastCapture;
+    return counter->captureKnown && (*count != 0);
+}
+
+void updateFrequencyCounter_(HWTimerChannel* hwTimer) {
+    HWTimerFrequencyCounter* counter = &hwTimer->frequency;
+
+    uint32_t count;
+    uint64_t capture;
+    if(!readFrequencyCounter_(hwTimer, &count, &capture)) return;
+    if(counter->gateOpen && (count == counter->gateCount)) return;
+
+    uint64_t time = applySyncCorrection_(capture, syncEpoch & HW_TIMER_SYNC_TAG_MASK);
+    uint32_t overcaptures = hwTimer->overcaptureCount;
+    uint32_t clockGaps = hwTimers.clockGaps;
+    // If captures were lost or the SYSCLK changed, the gate is wrong and it is discarded.
+    if(counter->gateOpen && (overcaptures == counter->gateOvercaptures) && 
+       (clockGaps == counter->gateClockGaps)) {
+        uint64_t gateLength = time - counter->gateTime;
+        if(gateLength < HW_TIMER_FREQ_GATE_TIME) return;
+
+        uint32_t edges = (count - counter->gateCount) * HW_TIMER_FREQ_EDGES_PER_CAPTURE;
+        hwTimer->lastFrequency = ((double) MCU_FREQUENCY) * edges / gateLength;
+        hwTimer->lastFrequencyCalculationTick = HAL_GetTick();
+    }
+
+    // The next gate opens on the capture that closed this one.
+    counter->gateOpen = 1;
+    counter->gateCount = count;
+    counter->gateTime = time;
+    counter->gateOvercaptures = overcaptures;
+    counter->gateClockGaps = clockGaps;
+}
+
+uint8_t nextDMALevel_(HWTimerChannel* channel) {
+    if(channel->icPolarity == TIM_INPUTCHANNELPOLARITY_RISING) {
+        return 1;
+    }else if(channel->icPolarity == TIM_INPUTCHANNELPOLARITY_FALLING) {
+        return 0;
+    }else {
+        return !channel->dmaLevel;
+    }
+}
+
+void mergeDMASlot_(HWTimerDMASlot* slot) {
+    HWTimerChannel* channel = slot->owner;
+    if(channel == NULL) return;
+
+#if HW_TIMER_32BIT_TIMEBASE
+    // The count is read before the timebase, so all captures up to it happened before "now". 
+    // Being 32-bit wide, they can be extended with the timebase as long as they are less than 2^32
+    // ticks old.
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    uint32_t writeCount = updateDMAWriteCount_(slot);
+    uint32_t now;
+    uint64_t nowTime = readInternalTime_(&now);
+    __set_PRIMASK(primask);
+
+    if((writeCount - slot->readCount) > HW_TIMER_DMA_BUFFER_SIZE) {
+        // The DMA has lapped the buffer and overwritten captures that weren't merged yet.
+        channel->droppedCount += writeCount - slot->readCount;
+        channel->pendingGap += writeCount - slot->readCount;
+        if(channel->icPolarity == TIM_INPUTCHANNELPOLARITY_BOTHEDGE) {
+            channel->dmaLevel ^= (writeCount - slot->readCount) & 0x01;
+        }
+        slot->readCount = writeCount;
+    }
+
+    while(slot->readCount != writeCount) {
+        uint32_t raw = slot->buffer[slot->readCount & (HW_TIMER_DMA_BUFFER_SIZE - 1)];
+        uint64_t capturedVal = nowTime - (uint32_t)(now - raw) + channel->phaseOffset;
+        uint8_t level = nextDMALevel_(channel);
+
+        // If the buffer is full, keep the capture in the DMA slot for the next call.
+        if(!pushTimestamp_(channel, (capturedVal << 1) | level)) return;
+
+        channel->dmaLevel = level;
+        slot->readCount++;
+    }
+#else
+    if(slot->overrun) {
+        // Snapshots were lost so the coarse of the pending captures can't be known. Discard them.
+        // The level keeps its parity as every capture toggles it.
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        uint32_t writeCount = slot->writeCount;
+        slot->lastCounter = slot->writeCounter;
+        __set_PRIMASK(primask);
+
+        channel->droppedCount += writeCount - slot->readCount;
+        channel->pendingGap += writeCount - slot->readCount;
+        if(channel->icPolarity == TIM_INPUTCHANNELPOLARITY_BOTHEDGE) {
+            channel->dmaLevel ^= (writeCount - slot->readCount) & 0x01;
+        }
+        slot->readCount = writeCount;
+        slot->firstOfPeriod = 1;
+        slot->snapshotTail = slot->snapshotHead;
+        slot->overrun = 0;
+        return;
+    }
+
+    while(slot->snapshotTail != slot->snapshotHead) {
+        HWTimerDMASnapshot* snap = 
+            slot->snapshots + (slot->snapshotTail & (HW_TIMER_DMA_SNAPSHOT_COUNT - 1));
+
+        if((snap->writeCount - slot->readCount) > HW_TIMER_DMA_BUFFER_SIZE) {
+            // The DMA has overwritten captures that weren't merged yet.
+            channel->droppedCount += snap->writeCount - slot->readCount;
+            channel->pendingGap += snap->writeCount - slot->readCount;
+            if(channel->icPolarity == TIM_INPUTCHANNELPOLARITY_BOTHEDGE) {
+                channel->dmaLevel ^= (snap->writeCount - slot->readCount) & 0x01;
+            }
+            slot->readCount = snap->writeCount;
+        }
+
+        // The captures between two snapshots contain a single master timer overflow. All of them
+        // are looked at before assigning their coarse.
+        if(slot->firstOfPeriod) {
+            splitDMASnapshot_(slot, snap);
+            slot->firstOfPeriod = 0;
+        }
+
+        while(slot->readCount != snap->writeCount) {
+            uint32_t raw = slot->buffer[slot->readCount & (HW_TIMER_DMA_BUFFER_SIZE - 1)];
+            uint8_t level = nextDMALevel_(channel);
+
+            if((slot->oldCount == 0) && (slot->ambiguousCount != 0)) {
+                // Its period can't be known, so it goes as a lost edge instead of a wrong one.
+                channel->droppedCount++;
+                channel->pendingGap++;
+                channel->dmaLevel = level;
+                slot->ambiguousCount--;
+                slot->readCount++;
+                continue;
+            }
+
+            uint64_t coarseOfRaw = (slot->oldCount != 0) ? snap->oldCoarse : snap->newCoarse;
+            uint64_t capturedVal = raw + coarseOfRaw + channel->phaseOffset;
+
+            // If the buffer is full, keep the capture in the DMA slot for the next call.
+            if(!pushTimestamp_(channel, (capturedVal << 1) | level)) return;
+
+            channel->dmaLevel = level;
+            if(slot->oldCount != 0) slot->oldCount--;
+            slot->readCount++;
+        }
+
+        // Next snapshot, which starts a new period.
+        slot->lastCounter = snap->counter;
+        slot->firstOfPeriod = 1;
+        slot->snapshotTail++;
+    }
+#endif
+}
+
+void splitDMASnapshot_(HWTimerDMASlot* slot, const HWTimerDMASnapshot* snap) {
+    uint32_t count = snap->writeCount - slot->readCount;
+    uint32_t low = (slot->lastCounter > HW_TIMER_DMA_SNAPSHOT_MARGIN) ? 
+                   slot->lastCounter - HW_TIMER_DMA_SNAPSHOT_MARGIN : 0;
+    uint32_t high = snap->counter + HW_TIMER_DMA_SNAPSHOT_MARGIN;
+
+    // The first capture of the new period is between minSplit and maxSplit.
+    uint32_t minSplit = 0, maxSplit = count;
+    uint32_t previousRaw = 0;
+    for(uint32_t i = 0; i < count; i++) {
+        uint32_t raw = slot->buffer[(slot->readCount + i) & (HW_TIMER_DMA_BUFFER_SIZE - 1)];
+        if((i > 0) && (raw < previousRaw)) {
+            // The overflow is right before this capture.
+            minSplit = i;
+            maxSplit = i;
+            break;
+        }
+
+        if(raw > high) {
+            // Only the old period gets this far.
+            minSplit = i + 1;
+        }else if((raw < low) && (maxSplit == count)) {
+            // Only the new period starts this low.
+            maxSplit = i;
+        }
+        previousRaw = raw;
+    }
+    if(maxSplit < minSplit) maxSplit = minSplit;
+
+    slot->oldCount = minSplit;
+    slot->ambiguousCount = maxSplit - minSplit;
+}
+
 void getChannelFrequencyAndDutyCycle(HWTimerChannel* hwTimer, 
                                      double* frequency, double* dutyCycle) {
-    
-    if(hwTimer->data.len < HW_TIMER_MIN_SAMPLES_NEEDED) {
+    HWTimerStatsWindow* window = &hwTimer->edgeStats.query;
+    if(window->cycleCount == 0) {
         if((HAL_GetTick() - hwTimer->lastFrequencyCalculationTick) > 
             HW_TIMER_TICKS_UNTIL_FREQ_RECALCULATE) {
             hwTimer->lastFrequency = -1.0;
@@ -196,76 +1520,484 @@ void getChannelFrequencyAndDutyCycle(HWTimerChannel* hwTimer,
         return;
     }
 
-    // This function can only be called on "Input" mode channels.
-    double periodSum = 0, risedTimeSum = 0;
-    uint64_t previousRisingTime = 0;
-    uint32_t cycleCount = 0;
-    uint8_t firstRising = 1;
+    // The sums are in ticks of the MCU. The SYNC correction stretches them by its scale, which is
+    // the same on the whole window up to a few ppb.
+    uint32_t epoch = syncEpoch;
+    __DMB();
+    HWTimerSyncRecord record = syncRecords[epoch & (HW_TIMER_SYNC_HISTORY_SIZE - 1)];
+    double scale = record.synchronized ? (record.scaleQ48 / (double) FIXED_POINT_Q48_ONE) : 1.0;
 
-    hwTimer->data.locked = 1;
-    uint64_t timestamp;
-    while(hwTimer->data.len > 0) {
-        if(!pop_cb64(&hwTimer->data, &timestamp)) break;
+    *frequency = ((double) MCU_FREQUENCY) * window->cycleCount / (window->periodSum * scale);
+    if(window->highPeriodSum > 0) {
+        *dutyCycle = window->highSum * 100.0 / window->highPeriodSum;
+    }else {
+        *dutyCycle = -1.0;
+    }
 
-        uint64_t time = timestamp >> 1;
-        uint32_t isRising = timestamp & 0x01ULL;
+    // The open period goes on to the next window.
+    memset(window, 0, sizeof(HWTimerStatsWindow));
 
-        if(!isRising) {
-            // Continue until a rising edge is found.
-            if(firstRising) continue;
+    hwTimer->lastFrequency = *frequency;
+    hwTimer->lastDutyCycle = *dutyCycle;
+    hwTimer->lastFrequencyCalculationTick = HAL_GetTick();
+}
+
+void accumulateEdge_(HWTimerChannel* channel, uint64_t timestamp) {
+    HWTimerEdgeStats* stats = &channel->edgeStats;
+    uint64_t time = timestamp >> 1;
+    stats->query.edgeCount++;
+    stats->report.edgeCount++;
 
-            // Break the loop if the last edge is a falling edge. The calculations must end on a 
-            // rising edge.
-            if(hwTimer->data.len == 0) break;
+    // Capturing a single edge, every capture starts a period and the prescaler tells how many 
+    // periods are in between. On both edges, the rising ones start the periods.
+    uint32_t periodsPerCapture = 1;
+    if(channel->icPolarity == TIM_INPUTCHANNELPOLARITY_BOTHEDGE) {
+        if(!(timestamp & 0x01ULL)) {
+            if(stats->periodOpen) {
+                stats->lastFalling = time;
+                stats->fallingSeen = 1;
+            }
+            return;
         }
+    }else {
+        periodsPerCapture = 1UL << (channel->icPrescaler >> TIM_CCMR1_IC1PSC_Pos);
+    }
 
-        int64_t delta = time - previousRisingTime;
-        if(isRising) {
-            if(!firstRising) {
-                periodSum += delta;
-                cycleCount++;
+    if(stats->periodOpen) {
+        uint64_t period = time - stats->lastRising;
+        uint64_t high = stats->lastFalling - stats->lastRising;
+        addPeriodToWindow_(&stats->query, period, periodsPerCapture, high, stats->fallingSeen);
+        addPeriodToWindow_(&stats->report, period, periodsPerCapture, high, stats->fallingSeen);
+
+        // Histogram channels capture both edges, so the period is a single cycle.
+        if(channel->isHistogram) {
+            addToHistogram_(&channel->histogram, HW_TIMER_HISTOGRAM_PERIOD, period);
+            if(stats->fallingSeen) {
+                addToHistogram_(&channel->histogram, HW_TIMER_HISTOGRAM_HIGH, high);
+                addToHistogram_(&channel->histogram, HW_TIMER_HISTOGRAM_LOW, period - high);
             }
-            previousRisingTime = time;
-            firstRising = 0;
-        }else {
-            risedTimeSum += delta;
         }
     }
 
-    hwTimer->data.locked = 0;
+    stats->periodOpen = 1;
+    stats->fallingSeen = 0;
+    stats->lastRising = time;
+}
 
-    if(cycleCount > 0) {
-        *frequency = ((double) MCU_FREQUENCY) * cycleCount / periodSum;
-        *dutyCycle = risedTimeSum * 100.0 / periodSum;
-    }else {
-        *frequency = -1.0;
-        *dutyCycle = -1.0;
+void addPeriodToWindow_(HWTimerStatsWindow* window, uint64_t period, uint32_t cycles, 
+                        uint64_t high, uint8_t hasHigh) {
+    uint64_t cyclePeriod = period / cycles;
+    if((window->cycleCount == 0) || (cyclePeriod < window->minPeriod)) {
+        window->minPeriod = cyclePeriod;
+    }
+    if((window->cycleCount == 0) || (cyclePeriod > window->maxPeriod)) {
+        window->maxPeriod = cyclePeriod;
     }
 
-    hwTimer->lastFrequency = *frequency;
-    hwTimer->lastDutyCycle = *dutyCycle;
-    hwTimer->lastFrequencyCalculationTick = HAL_GetTick();
+    window->cycleCount += cycles;
+    window->periodSum += period;
+    if(hasHigh) {
+        window->highSum += high;
+        window->highPeriodSum += period;
+    }
+}
+
+void accumulateGap_(HWTimerChannel* channel, uint32_t lostCount) {
+    channel->edgeStats.periodOpen = 0;
+    channel->edgeStats.query.edgeCount += lostCount;
+    channel->edgeStats.report.edgeCount += lostCount;
+}
+
+void addToHistogram_(HWTimerHistogram* histogram, HWTimerHistogramKind kind, uint64_t ticks) {
+    if(ticks < histogram->binStart) {
+        histogram->underflow[kind]++;
+        return;
+    }
+
+    uint64_t offset = ticks - histogram->binStart;
+    if(offset >= histogram->range) {
+        histogram->overflow[kind]++;
+        return;
+    }
+    histogram->slot->bins[kind][(uint32_t) offset / histogram->binWidth]++;
 }
 
 uint64_t getMIDDSTime(HWTimers* htimers) {
-    return coarse + __HAL_TIM_GET_COUNTER(htimers->htimMaster);
+    if(htimers == NULL) return 0;
+
+    uint64_t internalTime = readInternalTime_(NULL);
+    uint64_t time = applySyncCorrection_(internalTime, syncEpoch & HW_TIMER_SYNC_TAG_MASK);
+
+    // A read between a SYNC edge and its ISR is extrapolated with the previous correction, which 
+    // may be a fraction of a tick ahead of the new one. The internal time only goes back when the
+    // MIDDS time is set, and then the new time is taken as it is.
+    if((internalTime >= htimers->lastInternalTime) && (time < htimers->lastMIDDSTime)) {
+        time = htimers->lastMIDDSTime;
+    }
+    htimers->lastInternalTime = internalTime;
+    htimers->lastMIDDSTime = time;
+    return time;
+}
+
+CCM_CODE uint64_t readInternalTime_(uint32_t* counter) {
+    TIM_TypeDef* master = hwTimers.htimMaster->Instance;
+    uint64_t base;
+    uint32_t now;
+    uint32_t overflowPending;
+    uint32_t sequence;
+    // The coarse is 64-bit, so it is not read atomically. Read again if the ISR has changed it.
+    do {
+        sequence = timebaseSequence;
+        __DMB();
+        base = coarse;
+        now = master->CNT;
+        overflowPending = master->SR & TIM_FLAG_UPDATE;
+        __DMB();
+    } while((sequence & 0x01) || (sequence != timebaseSequence));
+
+    // The counter may have overflowed but its ISR hasn't updated the coarse yet.
+    if(overflowPending && (now < (HW_TIMER_TIMEBASE_PERIOD >> 1))) {
+        base += HW_TIMER_TIMEBASE_PERIOD;
+    }
+
+    if(counter != NULL) *counter = now;
+    return base + now;
 }
 
 // vvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvv
 // TIMER ISR FUNCTIONS
 // vvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvv
 
-inline void saveTimestamp_(HWTimerChannel* channel, uint8_t addCoarseIncrement) {
-    if(((channel->htim->Instance->SR & channel->channelMask) == 0) || 
-       ((channel->htim->Instance->DIER & channel->channelMask) == 0))
-    {
-        // If there's no capture input for this channel or is it not enabled, skip it.
+CCM_CODE void publishSyncRecord_(uint64_t measuredTime, uint64_t idealTime, uint64_t scaleQ48, 
+                                 uint8_t synchronized) {
+    // The next record is never read: the consumers keep one record away from it. See 
+    // applySyncCorrection_().
+    uint32_t epoch = syncEpoch + 1;
+    HWTimerSyncRecord* record = syncRecords + (epoch & (HW_TIMER_SYNC_HISTORY_SIZE - 1));
+    record->measuredTime = measuredTime;
+    record->idealTime = idealTime;
+    record->scaleQ48 = scaleQ48;
+    // Once per SYNC edge, so that the pulse outputs don't divide on each of their edges.
+    record->inverseQ48 = divQ48(FIXED_POINT_Q48_ONE, scaleQ48);
+    record->synchronized = synchronized;
+
+    // The record must be written before the consumers see it.
+    __DMB();
+    syncEpoch = epoch;
+}
+
+uint64_t applySyncCorrection_(uint64_t capturedVal, uint32_t syncTag) {
+    // The tag only keeps the lower bits of the record index. The records older than the history are
+    // replaced by the oldest one that the SYNC ISR can't overwrite during the copy.
+    uint32_t epoch = syncEpoch;
+    uint32_t age = (epoch - syncTag) & HW_TIMER_SYNC_TAG_MASK;
+    if(age > (HW_TIMER_SYNC_HISTORY_SIZE - 2)) {
+        age = HW_TIMER_SYNC_HISTORY_SIZE - 2;
+    }
+    __DMB();
+    HWTimerSyncRecord record = syncRecords[(epoch - age) & (HW_TIMER_SYNC_HISTORY_SIZE - 1)];
+
+    // Apply SYNC corrections only if SYNC was ready.
+    if(!record.synchronized) return capturedVal;
+
+    // SYNC corrections are an extrapolation from the last SYNC edge with the frequency estimated
+    // by the servo.
+    // captureIdeal = syncIdeal + (captureMeasured - syncMeasured)*scale
+    if(capturedVal >= record.measuredTime) {
+        // Enters here if this capture happened AFTER the SYNC pulse.
+        capturedVal = record.idealTime + 
+                      mulQ48(capturedVal - record.measuredTime, record.scaleQ48);
+    }else {
+        // Enters here if this capture happened BEFORE the SYNC pulse. Same formula but with a 
+        // little of unsigned math magic.
+        capturedVal = record.idealTime - 
+                      mulQ48(record.measuredTime - capturedVal, record.scaleQ48);
+    }
+
+    return capturedVal;
+}
+
+CCM_CODE void updateSyncServo_(uint64_t capturedVal, uint8_t level) {
+    if(syncQuality == HW_TIMER_SYNC_UNSYNCHRONIZED) {
+        // The ideal SYNC edges are aligned to the first rising edge.
+        if(!level) return;
+        syncAnchorIdeal = capturedVal;
+        syncFrequencyQ48 = FIXED_POINT_Q48_ONE;
+        syncPhaseError = 0;
+        syncConsecutiveGlitches = 0;
+        syncGoodEdges = 0;
+        lastSyncMeasured = capturedVal;
+        syncQuality = HW_TIMER_SYNC_ACQUIRING;
+        publishSyncRecord_(capturedVal, capturedVal, FIXED_POINT_Q48_ONE, 1);
+        return;
+    }
+
+    uint64_t period = hwTimers.idealPeriodHighSYNC + hwTimers.idealPeriodLowSYNC;
+    if(period == 0) return;
+
+    // Time of this edge with the current correction.
+    HWTimerSyncRecord* record = syncRecords + (syncEpoch & (HW_TIMER_SYNC_HISTORY_SIZE - 1));
+    uint64_t predicted = record->idealTime + 
+                         mulQ48(capturedVal - record->measuredTime, record->scaleQ48);
+
+    // Nearest ideal edge of the same level. The anchor follows the accepted edges, so the division
+    // only spans a few periods, unless the SYNC has been lost for a while.
+    uint64_t edgeOffset = level ? 0 : hwTimers.idealPeriodHighSYNC;
+    int64_t fromAnchor = predicted - (syncAnchorIdeal + edgeOffset);
+    int64_t periods = (fromAnchor >= 0) ? 
+                      (int64_t)((fromAnchor + period/2)/period) : 
+                      -(int64_t)((-fromAnchor + period/2)/period);
+    uint64_t ideal = syncAnchorIdeal + edgeOffset + periods*period;
+    int64_t phaseError = ideal - predicted;
+
+    if((phaseError > (int64_t) hwTimers.maxPhaseErrorSYNC) || 
+       (phaseError < -(int64_t) hwTimers.maxPhaseErrorSYNC)) {
+        // Too far from any ideal edge: a glitch or a missed edge. The correction is left as is.
+        syncGlitchCount++;
+        syncGoodEdges = 0;
+        if(++syncConsecutiveGlitches < HW_TIMER_SYNC_MAX_GLITCHES) return;
+
+        // The SYNC has moved. Acquire its phase again from this edge, keeping the frequency.
+        syncAnchorIdeal = predicted - edgeOffset;
+        syncPhaseError = 0;
+        syncConsecutiveGlitches = 0;
+        lastSyncMeasured = capturedVal;
+        syncQuality = HW_TIMER_SYNC_ACQUIRING;
+        publishSyncRecord_(capturedVal, predicted, syncFrequencyQ48, 1);
         return;
     }
 
+    // Phase error per measured tick since the last edge. The limit of maxPhaseErrorSYNC keeps it
+    // below 1. After over 2^52 ticks (325 days) of holdover, the frequency is left as is.
+    uint64_t elapsed = capturedVal - lastSyncMeasured;
+    if(elapsed == 0) return;
+    int64_t errorQ48 = (elapsed <= (1ULL << 52)) ? divQ48(phaseError, elapsed) : 0;
+
+    // PI loop. The proportional term removes the phase error over the next SYNC edges, so the 
+    // correction never jumps.
+    syncFrequencyQ48 += errorQ48 * HW_TIMER_SYNC_SERVO_KI_Q8 / 256;
+    int64_t scaleQ48 = syncFrequencyQ48 + errorQ48 * HW_TIMER_SYNC_SERVO_KP_Q8 / 256;
+    publishSyncRecord_(capturedVal, predicted, scaleQ48, 1);
+
+    if(level) {
+        hwTimers.measuredPeriodLowSYNC = elapsed;
+    }else {
+        hwTimers.measuredPeriodHighSYNC = elapsed;
+    }
+    syncAnchorIdeal = ideal - edgeOffset;
+    syncPhaseError = phaseError;
+    syncConsecutiveGlitches = 0;
+    lastSyncMeasured = capturedVal;
+
+    if(syncGoodEdges < HW_TIMER_GOOD_SYNCS_UNTIL_SYNCHRONIZED) syncGoodEdges++;
+    syncQuality = (syncGoodEdges >= HW_TIMER_GOOD_SYNCS_UNTIL_SYNCHRONIZED) ? 
+                  HW_TIMER_SYNC_LOCKED : HW_TIMER_SYNC_ACQUIRING;
+}
+
+CCM_CODE uint64_t removeSyncCorrection_(uint64_t idealTime) {
+    uint32_t epoch = syncEpoch;
+    __DMB();
+    HWTimerSyncRecord record = syncRecords[epoch & (HW_TIMER_SYNC_HISTORY_SIZE - 1)];
+    if(!record.synchronized) return idealTime;
+
+    // The scale is within a few ppm of 1.0, so its inverse in Q48 is as precise as the scale.
+    if(idealTime >= record.idealTime) {
+        return record.measuredTime + mulQ48(idealTime - record.idealTime, record.inverseQ48);
+    }else {
+        return record.measuredTime - mulQ48(record.idealTime - idealTime, record.inverseQ48);
+    }
+}
+
+CCM_CODE void schedulePulseEdge_(HWTimerChannel* channel) {
     __HAL_TIM_CLEAR_FLAG(channel->htim, channel->channelMask);
 
-    uint64_t capturedVal = HAL_TIM_ReadCapturedValue(channel->htim, channel->timChannel);
+    uint64_t now = readInternalTime_(NULL);
+    if(channel->pulseArmed) {
+        // The armed edge has just been output.
+        channel->nextPulseEdge += channel->nextPulseLevel ? 
+                                  channel->pulseWidth : (channel->pulsePeriod - channel->pulseWidth);
+        channel->nextPulseLevel = !channel->nextPulseLevel;
+        channel->pulseArmed = 0;
+    }
+
+    int64_t ticksToEdge = removeSyncCorrection_(channel->nextPulseEdge) - now;
+    // Too late to program the edge. Skip whole periods, so the level of the edge is kept.
+    for(uint8_t i = 0; 
+        (i < HW_TIMER_PULSE_MAX_SKIPPED_PERIODS) && (ticksToEdge < HW_TIMER_PULSE_MIN_LEAD); i++) {
+        channel->nextPulseEdge += channel->pulsePeriod;
+        ticksToEdge = removeSyncCorrection_(channel->nextPulseEdge) - now;
+    }
+    if((ticksToEdge < HW_TIMER_PULSE_MIN_LEAD) || 
+       (ticksToEdge > (int64_t)(2*channel->pulsePeriod))) {
+        // Far too late, or the MIDDS time has been set. Find the next edge again.
+        alignPulseOutput_(channel, now);
+        ticksToEdge = removeSyncCorrection_(channel->nextPulseEdge) - now;
+    }
+
+    // A bit less than a counter wrap, so the CCR can't be passed while it is being written.
+    int64_t window = channel->counterMask - HW_TIMER_PULSE_MIN_LEAD;
+    uint64_t target;
+    if(ticksToEdge <= window) {
+        target = now + ticksToEdge;
+        setOutputCompareMode_(channel, channel->nextPulseLevel ? 
+                                       TIM_OCMODE_ACTIVE : TIM_OCMODE_INACTIVE);
+        channel->pulseArmed = 1;
+    }else {
+        // Wake up when the edge is half a window away.
+        int64_t wait = ticksToEdge - window/2;
+        if(wait > window) wait = window;
+        target = now + wait;
+        setOutputCompareMode_(channel, TIM_OCMODE_TIMING);
+    }
+    // The TIMx counts the internal time minus its phase offset.
+    *channel->ccr = (target - channel->phaseOffset) & channel->counterMask;
+}
+
+void alignPulseOutput_(HWTimerChannel* channel, uint64_t internalTime) {
+    uint64_t period = channel->pulsePeriod;
+    uint64_t idealTime = applySyncCorrection_(internalTime + 2*HW_TIMER_PULSE_MIN_LEAD, 
+                                              syncEpoch & HW_TIMER_SYNC_TAG_MASK);
+    uint64_t phase = idealTime % period;
+
+    if(phase < channel->pulseWidth) {
+        channel->nextPulseEdge = idealTime - phase + channel->pulseWidth;
+        channel->nextPulseLevel = 0;
+    }else {
+        channel->nextPulseEdge = idealTime - phase + period;
+        channel->nextPulseLevel = 1;
+    }
+}
+
+CCM_CODE void setOutputCompareMode_(HWTimerChannel* channel, uint32_t ocMode) {
+    TIM_TypeDef* instance = channel->htim->Instance;
+    volatile uint32_t* ccmr = 
+        ((channel->timChannel == TIM_CHANNEL_1) || (channel->timChannel == TIM_CHANNEL_2)) ? 
+        &instance->CCMR1 : &instance->CCMR2;
+    uint32_t shift = 
+        ((channel->timChannel == TIM_CHANNEL_2) || (channel->timChannel == TIM_CHANNEL_4)) ? 8 : 0;
+    *ccmr = (*ccmr & ~(TIM_CCMR1_OC1M << shift)) | (ocMode << shift);
+}
+
+void initTimestampBuffer_(HWTimerChannel* channel, HWTimerPoolEntry* storage, uint32_t size) {
+    channel->pendingGap = 0;
+    channel->clockGaps = hwTimers.clockGaps;
+    // The first timestamp always goes with a SYNC tag.
+    channel->pushSyncTag = (syncEpoch - 1) & HW_TIMER_SYNC_TAG_MASK;
+    channel->popSyncTag = syncEpoch & HW_TIMER_SYNC_TAG_MASK;
+#if HW_TIMER_COMPACT_TIMESTAMPS
+    init_cb32(&channel->data, storage, size);
+    // The first timestamp always goes with a marker.
+    channel->pushEpoch = HW_TIMER_EPOCH_NONE;
+    channel->popEpoch = 0;
+#else
+    init_cb64(&channel->data, storage, size);
+#endif
+}
+
+uint32_t countStoredEdges_(HWTimerChannel* channel) {
+    uint32_t count = 0;
+#if HW_TIMER_COMPACT_TIMESTAMPS
+    CircularBuffer32* buffer = &channel->data;
+    uint32_t length = len_cb32(buffer);
+    for(uint32_t i = 0; i < length; i++) {
+        uint32_t entry = buffer->data[(buffer->tail + i) & buffer->mask];
+        if(!(entry & HW_TIMER_EPOCH_MARKER)) {
+            count++;
+        }else if((entry & HW_TIMER_ENTRY_TYPE_MASK) == HW_TIMER_GAP_ENTRY) {
+            count += entry & HW_TIMER_ENTRY_VALUE_MASK;
+        }else if((entry & HW_TIMER_ENTRY_TYPE_MASK) != HW_TIMER_SYNC_ENTRY) {
+            // Second half of an epoch marker.
+            i++;
+        }
+    }
+#else
+    CircularBuffer64* buffer = &channel->data;
+    uint32_t length = len_cb64(buffer);
+    for(uint32_t i = 0; i < length; i++) {
+        uint64_t entry = buffer->data[(buffer->tail + i) & buffer->mask];
+        if(entry & HW_TIMER_GAP_MARKER) {
+            count += entry & HW_TIMER_GAP_COUNT_MASK;
+        }else if(!(entry & HW_TIMER_SYNC_TAG_MARKER)) {
+            count++;
+        }
+    }
+#endif
+    return count;
+}
+
+CCM_CODE inline uint8_t pushTimestamp_(HWTimerChannel* channel, uint64_t timestamp) {
+    // The SYSCLK has changed since the last timestamp.
+    uint32_t clockGaps = hwTimers.clockGaps;
+    if(clockGaps != channel->clockGaps) {
+        channel->clockGaps = clockGaps;
+        channel->pendingGap++;
+    }
+
+    uint32_t gap = channel->pendingGap;
+    uint32_t syncTag = syncEpoch & HW_TIMER_SYNC_TAG_MASK;
+#if HW_TIMER_COMPACT_TIMESTAMPS
+    uint64_t epoch = timestamp >> HW_TIMER_EPOCH_SHIFT;
+    uint32_t offset = (uint32_t) timestamp & HW_TIMER_EPOCH_OFFSET_MASK;
+    if((gap == 0) && (syncTag == channel->pushSyncTag) && (epoch == channel->pushEpoch)) {
+        return push_cb32(&channel->data, offset);
+    }
+
+    // The epoch only changes every 2^30 ticks or on a SYNC time set, and the SYNC tag on each SYNC
+    // edge. If the markers don't fit, they are kept so the next push tries again.
+    uint32_t entries[5];
+    uint32_t count = 0;
+    if(gap > 0) {
+        if(gap > HW_TIMER_ENTRY_VALUE_MASK) gap = HW_TIMER_ENTRY_VALUE_MASK;
+        entries[count++] = HW_TIMER_EPOCH_MARKER | HW_TIMER_GAP_ENTRY | gap;
+    }
+    if(syncTag != channel->pushSyncTag) {
+        entries[count++] = HW_TIMER_EPOCH_MARKER | HW_TIMER_SYNC_ENTRY | syncTag;
+    }
+    if(epoch != channel->pushEpoch) {
+        entries[count++] = HW_TIMER_EPOCH_MARKER | (uint32_t)(epoch >> 32);
+        entries[count++] = (uint32_t) epoch;
+    }
+    entries[count++] = offset;
+    if(!pushN_cb32(&channel->data, entries, count)) return 0;
+    channel->pushEpoch = epoch;
+#else
+    if((gap == 0) && (syncTag == channel->pushSyncTag)) {
+        return push_cb64(&channel->data, timestamp);
+    }
+
+    uint64_t entries[3];
+    uint32_t count = 0;
+    if(gap > 0) {
+        entries[count++] = HW_TIMER_GAP_MARKER | gap;
+    }
+    if(syncTag != channel->pushSyncTag) {
+        entries[count++] = HW_TIMER_SYNC_TAG_MARKER | syncTag;
+    }
+    entries[count++] = timestamp;
+    if(!pushN_cb64(&channel->data, entries, count)) return 0;
+#endif
+    channel->pendingGap = 0;
+    channel->pushSyncTag = syncTag;
+    return 1;
+}
+
+CCM_CODE inline void saveTimestamp_(HWTimerChannel* channel, uint8_t addCoarseIncrement) {
+    PROFILER_START();
+
+    __HAL_TIM_CLEAR_FLAG(channel->htim, channel->channelMask);
+
+#if HW_TIMER_32BIT_TIMEBASE
+    // readInternalTime_() already pairs TIM2 with its coarse, so there is no coarse to choose.
+    (void) addCoarseIncrement;
+
+    // The timebase is read after the capture. The ticks elapsed since the capture are the difference
+    // of both counters, within the counter width of the capturing TIMx. All TIMx are reset at the 
+    // same time, so their lower bits match the timebase's (up to their phaseOffset).
+    uint32_t now;
+    uint64_t capturedVal = readInternalTime_(&now);
+    capturedVal -= (now - *channel->ccr) & channel->counterMask;
+#else
+    uint64_t capturedVal = *channel->ccr;
     // If during this function a restart event has ocurred (addCoarseIncrement = 1), then the 
     // captured value may belong to the new coarse which hasn't been updated still. If the captured
     // value is smaller than the current timer, then the captured value belongs to the new coarse
@@ -275,122 +2007,151 @@ inline void saveTimestamp_(HWTimerChannel* channel, uint8_t addCoarseIncrement)
     }else {
         capturedVal += coarse;
     }
+#endif
+    // Align the TIMx with the timebase.
+    capturedVal += channel->phaseOffset;
+
+    // The previous capture was overwritten before it could be read.
+    if(channel->htim->Instance->SR & channel->overcaptureMask) {
+        __HAL_TIM_CLEAR_FLAG(channel->htim, channel->overcaptureMask);
+        channel->overcaptureCount++;
+        channel->pendingGap++;
+    }
 
     uint64_t currentGPIOValue = (channel->gpioPort->IDR & channel->gpioPin) != 0;
     if(channel->isSYNC) {
-        if(currentGPIOValue) {
-            // If the current GPIO level is HIGH, that means that the LOW period has just occurred.
-            hwTimers.measuredPeriodLowSYNC = capturedVal - lastSyncMeasured;
-
-            if(newSyncTime != -1) {
-                // The computer has requested to set the MIDDS time.
-                
-                // By subtracting the current time, we make it so that when the current TIMx value
-                // is added to the coarse, "now" would be "newSyncTime".
-                coarse = newSyncTime - __HAL_TIM_GET_COUNTER(channel->htim);
-                if(addCoarseIncrement) {
-                    // This request is happening during a master timer update. Recalculate the new
-                    // coarse.
-                    newCoarse = coarse + 0x10000ULL;
-                }
-
-                lastSyncIdeal = newSyncTime;
-
-                newSyncTime = -1;
-
-                // Set the SYNC as not synchronized.
-                currentSyncState = 0xFF;
-                syncPulseCount = -1;
-            }else {
-                lastSyncIdeal += hwTimers.idealPeriodLowSYNC;
-            }
-        }else {
-            // If the current GPIO level is LOW, that means that the HIGH period has just occurred.
-            hwTimers.measuredPeriodHighSYNC = capturedVal - lastSyncMeasured;
-            lastSyncIdeal += hwTimers.idealPeriodHighSYNC;
-        }
-        lastSyncMeasured = capturedVal;
+        if(currentGPIOValue && (newSyncTime != -1)) {
+            // The computer has requested to set the MIDDS time on this rising edge. Shifting both
+            // coarses by the same amount makes this capture "newSyncTime", whichever coarse it 
+            // belongs to.
+            uint64_t shift = newSyncTime - capturedVal;
+            timebaseSequence++;
+            coarse += shift;
+            newCoarse += shift;
+            timebaseSequence++;
+            capturedVal = newSyncTime;
+            newSyncTime = -1;
 
-        if(syncPulseCount >= HW_TIMER_GOOD_SYNCS_UNTIL_SYNCHRONIZED){
-            currentSyncState = currentGPIOValue;
-        }else{
-            syncPulseCount++;
-        }
-    }
-    
-    // Apply SYNC corrections only if SYNC is ready.
-    if(currentSyncState != 0xFF){
-        // SYNC corrections are an interpolation between the previous HIGH or LOW measured period
-        // and the ideal periods that would give an ideal clock.
-        // captureMeasured - lastSyncMeasured   measuredSyncPeriod
-        // ---------------------------------- = ------------------ --> Calculate captureIdeal.
-        //    captureIdeal - lastSyncIdeal        realSyncPeriod
-        if(capturedVal >= lastSyncMeasured) {
-            // Enters here if this capture happened AFTER the current SYNC pulse.
-            if(currentSyncState == 0) {
-                capturedVal = lastSyncIdeal + 
-                              hwTimers.idealPeriodLowSYNC*(capturedVal - lastSyncMeasured)/
-                              hwTimers.measuredPeriodLowSYNC;
-            }else {
-                capturedVal = lastSyncIdeal + 
-                              hwTimers.idealPeriodHighSYNC*(capturedVal - lastSyncMeasured)/
-                              hwTimers.measuredPeriodHighSYNC;
-            }
-        }else {
-            // Enters here if this capture happened BEFORE the current SYNC pulse. Same formulas but
-            // with a little of unsigned math magic.
-            if(currentSyncState == 0) {
-                capturedVal = lastSyncIdeal - 
-                              hwTimers.idealPeriodLowSYNC*(lastSyncMeasured - capturedVal)/
-                              hwTimers.measuredPeriodLowSYNC;
-            }else {
-                capturedVal = lastSyncIdeal -
-                              hwTimers.idealPeriodHighSYNC*(lastSyncMeasured - capturedVal)/
-                              hwTimers.measuredPeriodHighSYNC;
-            }
+            // The servo starts over from this edge.
+            syncQuality = HW_TIMER_SYNC_UNSYNCHRONIZED;
         }
+
+        // The timestamps from now on are corrected with the new state, including this one.
+        updateSyncServo_(capturedVal, currentGPIOValue);
     }
 
-    // TODO: Make currentSyncState = 0xFF if enough time has passed since the last SYNC.
-    
     // Move the value to the left one bit. The LSB will signal the current state of the GPIO.
     capturedVal = (capturedVal << 1) | currentGPIOValue;
-    push_cb64(&channel->data, capturedVal);
+    if(!pushTimestamp_(channel, capturedVal)) {
+        channel->droppedCount++;
+        channel->pendingGap++;
+    }
+
+    PROFILER_END(PROFILER_SITE_SAVE_TIMESTAMP);
 }
 
-void captureInputISR_(TIM_HandleTypeDef* htim) {
-    __HAL_TIM_CLEAR_FLAG(htim, TIM_FLAG_UPDATE);
-    for(uint16_t i = 0; i < HW_TIMER_CHANNEL_COUNT; i++) {
-        if(htim->Instance != hwTimers.channels[i].htim->Instance) continue;
+CCM_CODE inline __attribute__((always_inline)) 
+void savePendingTimestamps_(TIM_TypeDef* instance, HWTimerChannel* const* ccChannels,
+                            uint8_t addCoarseIncrement) {
+    // Only the captures that are both pending and enabled. The channels on DMA have their CCxIE
+    // disabled, so their flags are left for the DMA requests.
+    uint32_t pending = instance->SR & instance->DIER & HW_TIMER_CC_FLAGS;
+    while(pending != 0) {
+        // Count the trailing zeros to get the CCx of the lowest pending flag. CC1IF is on bit 1.
+        uint32_t flagBit = __CLZ(__RBIT(pending));
+        pending &= pending - 1;
 
-        // Don't add the coarse increment. That's only done when a timer update has occurred.
-        saveTimestamp_(hwTimers.channels+i, 0);
+        HWTimerChannel* channel = ccChannels[flagBit - 1];
+        if(channel == NULL) {
+            // Should not happen, no unused CCx gets its ISR enabled.
+            instance->SR = ~(1UL << flagBit);
+            continue;
+        }
+        if(channel->isPulseOutput) {
+            schedulePulseEdge_(channel);
+            continue;
+        }
+        saveTimestamp_(channel, addCoarseIncrement);
     }
 }
 
-void restartMasterTimerISR_(TIM_HandleTypeDef* htim) {
-    // This function is only called by TIM1 (the master timer).
-    // Even though captureInputISR_() and this function have the same priority in NVIC, this 
+// Generates the capture ISR of a TIMx. As the TIMx and its index are constants, the compiler 
+// resolves the registers and the ccChannels row at compile time.
+#define HW_TIMER_CAPTURE_ISR(TIMx, timIndex)                                \
+    CCM_CODE void captureInput##TIMx##ISR_() {                              \
+        /* Don't add the coarse increment. That's only done when a timer */ \
+        /* update has occurred. */                                          \
+        savePendingTimestamps_(TIMx, hwTimers.ccChannels[timIndex], 0);     \
+    }
+
+HW_TIMER_CAPTURE_ISR(TIM1, 0)
+HW_TIMER_CAPTURE_ISR(TIM2, 1)
+HW_TIMER_CAPTURE_ISR(TIM3, 2)
+HW_TIMER_CAPTURE_ISR(TIM4, 3)
+HW_TIMER_CAPTURE_ISR(TIM5, 4)
+
+CCM_CODE void restartMasterTimerISR_(TIM_HandleTypeDef* htim) {
+    // This function is only called by the master timer (TIM1, or TIM2 on a 32-bit timebase).
+    // Even though captureInputTIMxISR_() and this function have the same priority in NVIC, this 
     // function interrupts the previous one, I suppose it has something to do with hardware 
     // priority.
     uint32_t itFlags   = htim->Instance->SR;
     uint32_t itEnabled = htim->Instance->DIER;
 
-    if(((itFlags & TIM_FLAG_UPDATE) == TIM_FLAG_UPDATE) && 
-       ((itEnabled & TIM_IT_UPDATE) == TIM_IT_UPDATE)) {
-        // Doing a clock overflow reset.
-        newCoarse = coarse + 0x10000ULL;
+    // On a 32-bit timebase, TIM2 shares its IRQ with its captures, so this may be called without
+    // an overflow.
+    if(((itFlags & TIM_FLAG_UPDATE) == 0) || ((itEnabled & TIM_IT_UPDATE) == 0)) return;
+
+    PROFILER_START();
+
+    // Doing a clock overflow reset.
+    newCoarse = coarse + HW_TIMER_TIMEBASE_PERIOD;
+
+#if !HW_TIMER_32BIT_TIMEBASE
+    // Take a snapshot of the channels on DMA so the main loop knows which coarse belongs to
+    // each raw capture.
+    uint32_t activeSlots = hwTimers.activeDMASlots;
+    for(uint16_t i = 0; activeSlots != 0; i++, activeSlots >>= 1) {
+        if((activeSlots & 0x01) == 0) continue;
+        HWTimerDMASlot* slot = hwTimers.dmaSlots + i;
+
+        uint32_t writeCount = updateDMAWriteCount_(slot);
+        uint32_t counter = __HAL_TIM_GET_COUNTER(htim);
+        slot->writeCounter = counter;
+
+        if((slot->snapshotHead - slot->snapshotTail) >= HW_TIMER_DMA_SNAPSHOT_COUNT) {
+            slot->overrun = 1;
+            continue;
+        }
+
+        HWTimerDMASnapshot* snap = 
+            slot->snapshots + (slot->snapshotHead & (HW_TIMER_DMA_SNAPSHOT_COUNT - 1));
+        snap->writeCount = writeCount;
+        snap->counter = counter;
+        snap->oldCoarse = coarse;
+        snap->newCoarse = newCoarse;
+        __DMB();
+        slot->snapshotHead++;
     }
 
     // Before adding the coarse, check if there are any pending Capture Inputs on the timer 
     // channels. If there are, save them but take into account that an clock reset has happened 
     // and the captured value may pertain to the new coarse, which still hasn't been incremented.
-    for(uint16_t i = 0; i < HW_TIMER_CHANNEL_COUNT; i++) {
-        saveTimestamp_(hwTimers.channels + i, 1);
-    }
+    // All TIMx are reset by the master, so all of them may have captures of the old coarse. Only 
+    // the pending ones are processed.
+    savePendingTimestamps_(TIM1, hwTimers.ccChannels[0], 1);
+    savePendingTimestamps_(TIM2, hwTimers.ccChannels[1], 1);
+    savePendingTimestamps_(TIM3, hwTimers.ccChannels[2], 1);
+    savePendingTimestamps_(TIM4, hwTimers.ccChannels[3], 1);
+    savePendingTimestamps_(TIM5, hwTimers.ccChannels[4], 1);
+#endif
     
-    // After all channels have been updated, modify the coarse.
+    // After all channels have been updated, modify the coarse. The readers must see the new coarse
+    // and the cleared flag together.
+    timebaseSequence++;
     coarse = newCoarse;
-    
     __HAL_TIM_CLEAR_FLAG(htim, TIM_FLAG_UPDATE);
+    timebaseSequence++;
+
+    PROFILER_END(PROFILER_SITE_RESTART_MASTER_TIMER);
 }
@@ -19,19 +19,331 @@
 #include "stm32g4xx_hal.h"
 #include "stm32g4xx_hal_tim.h"
 
+#include "CircularBuffer32.h"
 #include "CircularBuffer64.h"
+#include "LinkerSections.h"
 
 #define HW_TIMER_CHANNEL_COUNT                  16
+// If 1, the timebase is the 32-bit TIM2 instead of the 16-bit TIM1. The coarse then only needs to 
+// be updated every 2^32 ticks (26.8 s at 160 MHz) instead of every 65536 ticks (409.6 us). Captures
+// of the 16-bit TIMx are extended with the timebase counter read inside the ISR. In this mode, only
+// the channels of TIM2 and TIM5 (the 32-bit TIMx) can be set on HW_TIMER_CAPTURE_DMA.
+#define HW_TIMER_32BIT_TIMEBASE                 1
+
+#if HW_TIMER_32BIT_TIMEBASE
+#define HW_TIMER_TIMEBASE_PERIOD                0x100000000ULL
+#else
+#define HW_TIMER_TIMEBASE_PERIOD                0x10000ULL
+#endif
+
+// If 1, the timestamps are stored in 32-bit entries: the 31 lower bits of the timestamp (ticks and
+// GPIO level). The upper bits, the epoch, are only stored when they change, in a 64-bit marker made
+// of two entries. The first one has HW_TIMER_EPOCH_MARKER set. An epoch lasts 2^30 ticks (6.7 s at
+// 160 MHz), so the same pool holds almost twice the timestamps. If 0, each timestamp takes a full 
+// 64-bit entry.
+#define HW_TIMER_COMPACT_TIMESTAMPS             1
+
+#if HW_TIMER_COMPACT_TIMESTAMPS
+#define HW_TIMER_EPOCH_MARKER                   0x80000000UL
+// Other entries with HW_TIMER_EPOCH_MARKER set, told apart by HW_TIMER_ENTRY_TYPE_MASK. The epoch
+// marker always has these bits cleared.
+#define HW_TIMER_ENTRY_TYPE_MASK                0x60000000UL
+#define HW_TIMER_ENTRY_VALUE_MASK               0x1FFFFFFFUL
+// A gap. The value is the number of lost edges.
+#define HW_TIMER_GAP_ENTRY                      0x40000000UL
+// A SYNC tag. The value is the SYNC record of the next timestamps.
+#define HW_TIMER_SYNC_ENTRY                     0x60000000UL
+#define HW_TIMER_EPOCH_SHIFT                    31
+#define HW_TIMER_EPOCH_OFFSET_MASK              0x7FFFFFFFUL
+// Epoch of a channel that has not pushed a marker yet. Impossible for a real timestamp.
+#define HW_TIMER_EPOCH_NONE                     UINT64_MAX
+// Entries shared by all HWTimerChannels. 
+#define HW_TIMER_POOL_SIZE                      4096
+typedef uint32_t HWTimerPoolEntry;
+#else
+#define HW_TIMER_POOL_SIZE                      2048
+typedef uint64_t HWTimerPoolEntry;
+#endif
+
+// A popped timestamp with this bit set is a gap: edges were lost between the previous and the next
+// timestamps. The lower 32 bits are the number of lost edges. Real timestamps never reach this bit.
+#define HW_TIMER_GAP_MARKER                     0x8000000000000000ULL
+#define HW_TIMER_GAP_COUNT_MASK                 0xFFFFFFFFULL
+// Entry of a SYNC tag when the timestamps are not compact. The lower bits are the SYNC record.
+#define HW_TIMER_SYNC_TAG_MARKER                0x4000000000000000ULL
+// Sent in place of a timestamp when a monitor channel starts (HW_TIMER_OVERLOAD_START set) or stops
+// sending statistics instead of its timestamps. When it stops, the lower 32 bits are the number of 
+// edges summarized by the statistics.
+#define HW_TIMER_OVERLOAD_MARKER                0xC000000000000000ULL
+#define HW_TIMER_OVERLOAD_START                 0x0000000100000000ULL
+
+// Overload fallback of the monitor channels. A channel that loses edges or fills 3/4 of its buffer 
+// stops sending its timestamps and sends statistics every HW_TIMER_OVERLOAD_REPORT_INTERVAL ms 
+// instead. It goes back to its timestamps after a whole interval with fewer edges than its resume 
+// rate and no lost edges.
+#define HW_TIMER_OVERLOAD_REPORT_INTERVAL       1000 // ms
+// Resume rate in edges/s. The monitor messages carry about 100k timestamps/s over the USB, shared 
+// by all channels.
+#define HW_TIMER_OVERLOAD_DEFAULT_RATE          20000
+
+// Histograms of the histogram channels. Each channel bins its periods, high widths and low widths 
+// in HW_TIMER_HISTOGRAM_MAX_BINS bins at most, in ticks without the SYNC correction. By default, 
+// from 0 to 6.4 us in bins of 100 ns, sent every 10 s.
+#define HW_TIMER_HISTOGRAM_MAX_BINS             64
+#define HW_TIMER_HISTOGRAM_DEFAULT_BINS         64
+#define HW_TIMER_HISTOGRAM_DEFAULT_BIN_WIDTH    16
+#define HW_TIMER_HISTOGRAM_DEFAULT_INTERVAL     10000 // ms
+// Bins of the histogram channels, taken only by the channels on histogram mode. One per channel, 
+// so all of them can be histograms at once. They are kept in SRAM1 (768 bytes each), as they don't
+// fit in the CCM SRAM together with the rest of HWTimers.
+#define HW_TIMER_HISTOGRAM_SLOT_COUNT           16
+
+// The timestamps are stored without the SYNC correction, which is done when they are popped. The
+// SYNC ISR publishes a new HWTimerSyncRecord on each SYNC edge, and the timestamps are tagged with 
+// the record that was current when they were stored. Must be a power of two. At the maximum SYNC
+// frequency (two records per period at 99.99 Hz), the history covers 160 ms. Older timestamps are 
+// corrected with the oldest record.
+#define HW_TIMER_SYNC_HISTORY_SIZE              32
+// Bits of the SYNC tags stored with the timestamps.
+#define HW_TIMER_SYNC_TAG_MASK                  0x1FFFFFFFUL
+// Milliseconds between timebase descriptors while a channel sends raw timestamps. A descriptor is 
+// also sent on each new SYNC record.
+#define HW_TIMER_DESCRIPTOR_INTERVAL            1000
+
+// Only the channels that store timestamps get a part of the pool, proportional to their weight.
+// Minimum number of entries of a channel using the pool. Must be a power of two and 
+// HW_TIMER_CHANNEL_COUNT times it must fit in HW_TIMER_POOL_SIZE.
+#define HW_TIMER_POOL_MIN_CHANNEL_SIZE          16
+#define HW_TIMER_POOL_DEFAULT_WEIGHT            1
+
+// Number of TIMx used by the HWTimerChannels (TIM1 to TIM5).
+#define HW_TIMER_TIM_COUNT                      5
+// Capture/compare channels of each TIMx.
+#define HW_TIMER_CHANNELS_PER_TIM               4
+// CC1IF to CC4IF of the TIMx SR register, which are also CC1IE to CC4IE in the DIER register.
+#define HW_TIMER_CC_FLAGS                       (TIM_FLAG_CC1 | TIM_FLAG_CC2 | TIM_FLAG_CC3 | TIM_FLAG_CC4)
+// Counter reads taken on each TIMx to measure its phase offset against the timebase.
+#define HW_TIMER_PHASE_CALIBRATION_SAMPLES      64
 #define HW_TIMER_GOOD_SYNCS_UNTIL_SYNCHRONIZED  3
-#define HW_TIMER_MIN_SAMPLES_NEEDED             4
+// Gains of the SYNC servo in Q8 (x/256). With KP = 3/4 and KI = 1/4 both poles of the loop are at 
+// 0.5: the phase and frequency errors halve on every SYNC edge, without overshoot.
+#define HW_TIMER_SYNC_SERVO_KP_Q8               192
+#define HW_TIMER_SYNC_SERVO_KI_Q8               64
+// SYNC periods without edges until the SYNC is considered lost and the servo goes on holdover.
+#define HW_TIMER_SYNC_HOLDOVER_PERIODS          3
+// Consecutive rejected SYNC edges until the servo gives up the current phase and acquires again.
+#define HW_TIMER_SYNC_MAX_GLITCHES              8
 // From this value depends the minimum frequency that can be measured with MIDDS.
 #define HW_TIMER_TICKS_UNTIL_FREQ_RECALCULATE   30000 // ticks = ms
 
+// Pulse output. The next edge is programmed on the CCR of the TIMx once it is closer than a counter 
+// wrap. The ISR must be done HW_TIMER_PULSE_MIN_LEAD ticks before the edge, so the edges must be at
+// least HW_TIMER_PULSE_MIN_LENGTH ticks apart. On a 16-bit TIMx, the ISR also wakes up once per 
+// counter wrap while waiting for the next edge.
+#define HW_TIMER_PULSE_MIN_LEAD                 256
+#define HW_TIMER_PULSE_MIN_LENGTH               1600
+// If the ISR is late, the next edge is moved by whole periods up to this many times. Further 
+// behind, or if the MIDDS time was set, it is found again by alignPulseOutput_().
+#define HW_TIMER_PULSE_MAX_SKIPPED_PERIODS      16
+#define HW_TIMER_PULSE_DEFAULT_PERIOD           MCU_FREQUENCY
+#define HW_TIMER_PULSE_DEFAULT_WIDTH            (MCU_FREQUENCY / 10)
+
+// Frequency counter. The input prescaler of the CCx counts the rising edges and only every 
+// HW_TIMER_FREQ_EDGES_PER_CAPTURE edge is captured. The frequency is the count of edges between the
+// first and the last capture of a gate, divided by the time between both (reciprocal counting). The 
+// gate lasts at least HW_TIMER_FREQ_GATE_TIME ticks: 100 ms gives a resolution of 0.06 ppm.
+#define HW_TIMER_FREQ_PRESCALER                 TIM_ICPSC_DIV8
+#define HW_TIMER_FREQ_EDGES_PER_CAPTURE         8
+#define HW_TIMER_FREQ_GATE_TIME                 (MCU_FREQUENCY / 10)
+// Transfers of a lap of the DMA of a frequency counter. Its laps are counted by the interrupts of 
+// the slot, so the main loop may read it at any time. Must be even.
+#define HW_TIMER_FREQ_DMA_LENGTH                0x8000
+// A raw capture is only extended if the previous read of the counter is less than the period of
+// the TIMx minus this margin (in ticks) old, so that it can't be older than one period.
+#define HW_TIMER_FREQ_READ_MARGIN               128
+
+// Number of DMA channels reserved for the DMA capture mode. They are taken from DMA2, so DMA1 stays
+// free for other peripherals.
+#define HW_TIMER_DMA_SLOT_COUNT                 8
+// Raw capture entries of each DMA slot. Must be a power of two. At 1 MHz edges it gives the main
+// loop 512 us to drain the slot.
+#define HW_TIMER_DMA_BUFFER_SIZE                512
+// Master timer overflows that can be pending to be merged on each DMA slot. Must be a power of two.
+#define HW_TIMER_DMA_SNAPSHOT_COUNT             32
+// Ticks added around the master timer values of the snapshots when telling apart the captures of 
+// the old and the new period: reading the DMA counter, the latency of the DMA and the phase offsets
+// of the TIMx.
+#define HW_TIMER_DMA_SNAPSHOT_MARGIN            128
+
+// How the captured edges of a HWTimerChannel reach its circular buffer.
+typedef enum HWTimerCaptureMode {
+    // One ISR per edge. The coarse is added inside the ISR.
+    HW_TIMER_CAPTURE_ISR = 0,
+    // The TIMx CCx request triggers a DMA transfer of the raw CCR. The main loop merges the coarse
+    // in bulk. Not available for the SYNC channel.
+    HW_TIMER_CAPTURE_DMA,
+} HWTimerCaptureMode;
+
+// State of the DMA at a master timer overflow. Used to know which coarse belongs to each raw 
+// capture of a DMA slot.
+typedef struct HWTimerDMASnapshot {
+    uint32_t    writeCount;     // Number of captures written by the DMA when the overflow was seen.
+    uint32_t    counter;        // Master timer value just after reading the DMA counter.
+    uint64_t    oldCoarse;      // Coarse of the period that has just finished.
+    uint64_t    newCoarse;      // Coarse of the period that has just started.
+} HWTimerDMASnapshot;
+
+struct HWTimerChannel;
+
+// A DMA channel streaming the raw captures of a HWTimerChannel.
+typedef struct HWTimerDMASlot {
+    DMA_HandleTypeDef       hdma;
+    struct HWTimerChannel*  owner;      // NULL if the slot is free.
+
+    // Raw CCR values written by the DMA in circular mode.
+    uint32_t                buffer[HW_TIMER_DMA_BUFFER_SIZE];
+    // Transfers of a lap of the DMA. Even, so that the half transfer comes on a whole transfer.
+    uint32_t                length;
+    // Half transfer and transfer complete interrupts since the DMA started. Along with the DMA 
+    // counter, they give the exact count of transfers even if the DMA lapped the buffer.
+    volatile uint32_t       halfLaps;
+    // Captures written by the DMA (free running). Only written by updateDMAWriteCount_().
+    volatile uint32_t       writeCount;
+    // Master timer value read by the master timer ISR right after writeCount. 16-bit timebase only.
+    volatile uint32_t       writeCounter;
+    // Captures merged into the owner's buffer (free running). Only written by the main loop.
+    uint32_t                readCount;
+
+    HWTimerDMASnapshot      snapshots[HW_TIMER_DMA_SNAPSHOT_COUNT];
+    volatile uint32_t       snapshotHead;   // Written by the master timer ISR.
+    volatile uint32_t       snapshotTail;   // Written by the main loop.
+    // Set by the ISR if the main loop couldn't keep up and snapshots were lost.
+    volatile uint8_t        overrun;
+    
+    // Master timer value of the previous snapshot. The captures of the old period of the next 
+    // snapshot were done after it. Only used by the main loop.
+    uint32_t                lastCounter;
+    // Merge state of the snapshot being processed. See splitDMASnapshot_().
+    uint8_t                 firstOfPeriod;
+    uint32_t                oldCount;       // Captures left that belong to the old coarse.
+    uint32_t                ambiguousCount; // Captures left that may belong to either coarse.
+} HWTimerDMASlot;
+
+// Reciprocal counter of a HWTimerChannel on frequency mode.
+typedef struct HWTimerFrequencyCounter {
+    // The captures are always counted by the DMA of a slot. If set, the slot was taken only for 
+    // the counter, as the channel is on HW_TIMER_CAPTURE_ISR.
+    uint8_t             ownsSlot;
+    // Raw CCR written by the DMA. The DMA doesn't increment its address, so the write count of the
+    // slot is the count of captures.
+    volatile uint32_t   dmaCapture;
+    // Captures of the CCx (free running) and internal time of the last one.
+    uint32_t            captureCount;
+    uint64_t            lastCapture;
+    // Cleared if the time of the last capture couldn't be recovered.
+    uint8_t             captureKnown;
+    // Internal time of the last read of the DMA.
+    uint64_t            lastReadTime;
+
+    // Opening of the current gate: count of captures and MIDDS time of the capture.
+    uint8_t             gateOpen;
+    uint32_t            gateCount;
+    uint64_t            gateTime;
+    uint32_t            gateOvercaptures;
+    uint32_t            gateClockGaps;
+} HWTimerFrequencyCounter;
+
+// Statistics of the edges of a HWTimerChannel since the window was last read. In ticks without the
+// SYNC correction.
+typedef struct HWTimerStatsWindow {
+    // Popped edges, plus the ones lost before them.
+    uint32_t            edgeCount;
+    uint32_t            cycleCount;
+    uint64_t            periodSum;
+    // Only the periods with both edges: the high time and the period that contained it.
+    uint64_t            highSum;
+    uint64_t            highPeriodSum;
+    // Of a single cycle. Only valid if cycleCount > 0.
+    uint64_t            minPeriod;
+    uint64_t            maxPeriod;
+} HWTimerStatsWindow;
+
+// Running statistics of the periods and high levels of a HWTimerChannel, fed by every popped 
+// timestamp. Each reader has its own window.
+typedef struct HWTimerEdgeStats {
+    // Set once a period has started (a rising edge, or any edge on a single edge capture).
+    uint8_t             periodOpen;
+    // Set if the falling edge of the open period has been seen.
+    uint8_t             fallingSeen;
+    uint64_t            lastRising;
+    uint64_t            lastFalling;
+
+    // Read by the FREQUENCY command.
+    HWTimerStatsWindow  query;
+    // Read by the statistics reports of an overloaded channel.
+    HWTimerStatsWindow  report;
+} HWTimerEdgeStats;
+
+// Statistics report of an overloaded channel. The periods are in ticks.
+typedef struct HWTimerStatsReport {
+    uint32_t            edgeCount;
+    uint32_t            cycleCount;
+    uint64_t            minPeriod;
+    uint64_t            maxPeriod;
+    uint64_t            meanPeriod;
+    // In %, or -1 if no high level was seen.
+    double              dutyCycle;
+} HWTimerStatsReport;
+
+// Widths binned by the histogram of a HWTimerChannel.
+typedef enum HWTimerHistogramKind {
+    HW_TIMER_HISTOGRAM_PERIOD = 0,
+    HW_TIMER_HISTOGRAM_HIGH,
+    HW_TIMER_HISTOGRAM_LOW,
+    HW_TIMER_HISTOGRAM_KIND_COUNT
+} HWTimerHistogramKind;
+
+// Bins of the histograms of a HWTimerChannel.
+typedef struct HWTimerHistogramSlot {
+    struct HWTimerChannel*  owner;      // NULL if the slot is free.
+    uint32_t                bins[HW_TIMER_HISTOGRAM_KIND_COUNT][HW_TIMER_HISTOGRAM_MAX_BINS];
+} HWTimerHistogramSlot;
+
+// Histograms of the periods, high widths and low widths of a HWTimerChannel, fed by every popped 
+// timestamp. Each kind is cleared when it is sent. Consumer only.
+typedef struct HWTimerHistogram {
+    // The bins go from binStart to binStart + binWidth*binCount, in ticks. binWidth*binCount fits 
+    // in 32 bits, so the values within the range are binned with a 32-bit division.
+    uint32_t            binStart;
+    uint32_t            binWidth;
+    uint16_t            binCount;
+    uint32_t            range;
+    // Values below binStart and from the end of the range.
+    uint32_t            underflow[HW_TIMER_HISTOGRAM_KIND_COUNT];
+    uint32_t            overflow[HW_TIMER_HISTOGRAM_KIND_COUNT];
+    // Only valid while the channel is on histogram mode.
+    HWTimerHistogramSlot* slot;
+
+    // Milliseconds between reports, 0 to only send them on request.
+    uint32_t            reportInterval;
+    uint32_t            reportTick;
+    // Bit mask of the HWTimerHistogramKind of the current report not sent yet.
+    uint8_t             pendingKinds;
+} HWTimerHistogram;
+
 // Related data and timestamps of a single Hardware Timer.
 typedef struct HWTimerChannel {
     TIM_HandleTypeDef*  htim;
     uint32_t            timChannel;     // TIM_CHANNEL_1-4
     uint32_t            channelMask;    // TIM_FLAG_CC1-4
+    uint32_t            overcaptureMask;// TIM_FLAG_CC1OF-CC4OF
+    volatile uint32_t*  ccr;            // TIMx->CCR1-4, where the captures are stored.
+    uint32_t            dmaMask;        // TIM_DMA_CC1-4
+    uint32_t            dmaRequest;     // DMA_REQUEST_TIMx_CHy
+    uint32_t            counterMask;    // 0xFFFF or 0xFFFFFFFF, depending on the TIMx counter width.
+    // Ticks added to the captures of its TIMx to align them with the timebase. Copied from 
+    // HWTimers.phaseOffsets so the ISR has it at hand.
+    int32_t             phaseOffset;
     GPIO_TypeDef*       gpioPort;
     uint32_t            gpioPin;
     uint8_t             isSYNC;
@@ -42,10 +354,136 @@ typedef struct HWTimerChannel {
     double              lastFrequency;
     double              lastDutyCycle;
     uint32_t            lastFrequencyCalculationTick;
+    HWTimerEdgeStats    edgeStats;
+    // Set if the timestamps are only used for the edge statistics, so the main loop pops them as 
+    // they come (input channels).
+    uint8_t             statsOnly;
+
+    // Resume rate of the overload fallback, in edges/s. 0 disables it.
+    uint32_t            overloadRate;
+    // Set while the channel sends statistics instead of its timestamps.
+    uint8_t             overloaded;
+    // droppedCount + overcaptureCount on the last check.
+    uint32_t            overloadLostCount;
+    uint32_t            overloadReportTick;
+    // Edges summarized since the channel got overloaded.
+    uint32_t            overloadEdgeCount;
+    // HW_TIMER_OVERLOAD_MARKER to send before the next timestamp, or 0.
+    uint64_t            pendingMarker;
+
+    // Set if the channel bins its periods and widths instead of sending its timestamps. See 
+    // setHWTimerHistogramEnabled().
+    uint8_t             isHistogram;
+    HWTimerHistogram    histogram;
+
+    HWTimerCaptureMode  captureMode;
+    HWTimerDMASlot*     dmaSlot;        // Only valid on HW_TIMER_CAPTURE_DMA.
+    uint32_t            icPolarity;     // TIM_INPUTCHANNELPOLARITY_x of the capture.
+    uint32_t            icFilter;       // Digital filter of the input, 0 to 15 (ICxF).
+    // TIM_ICPSC_DIVx. Only used when capturing a single edge: the level of the captured edges 
+    // can't be known when capturing both edges.
+    uint32_t            icPrescaler;
+    uint8_t             dmaLevel;       // GPIO level after the last merged DMA capture.
 
+    // Set if the channel outputs pulses with its output compare instead of capturing.
+    uint8_t             isPulseOutput;
+    // Set when the CCR holds nextPulseEdge. Otherwise, the CCR is only a wake-up of the ISR.
+    uint8_t             pulseArmed;
+    uint8_t             nextPulseLevel;
+    // The rising edges are on the multiples of pulsePeriod of MIDDS time, in ticks.
+    uint64_t            pulsePeriod;
+    uint64_t            pulseWidth;
+    // MIDDS time of the next edge, in ticks.
+    uint64_t            nextPulseEdge;
+
+    // Set if the channel only counts its captures to get its frequency, without timestamps.
+    uint8_t             isFrequencyCounter;
+    HWTimerFrequencyCounter frequency;
+
+    // Set if the channel stores its timestamps, so it takes memory from the pool.
+    uint8_t             needsBuffer;
+    // Share of the pool taken by this channel relative to the other channels using the pool.
+    uint8_t             bufferWeight;
+    // If set, the timestamps are sent in ticks without the SYNC correction, together with their 
+    // SYNC tags. The computer corrects them with the timebase descriptors.
+    uint8_t             rawTimestamps;
+
+    // Edges lost since the last stored timestamp. Stored as a gap before the next one. Producer 
+    // only.
+    uint32_t            pendingGap;
+    // Value of HWTimers.clockGaps when the last timestamp was stored. Producer only.
+    uint32_t            clockGaps;
+    // SYNC record of the last stored timestamp. Producer only.
+    uint32_t            pushSyncTag;
+    // SYNC record of the last popped timestamp. Consumer only.
+    uint32_t            popSyncTag;
+    // Pairing of the edges of a monitor pulses channel. Consumer only.
+    uint8_t             pairPending;    // Set if a rising edge is waiting for its falling edge.
+    uint64_t            pairRising;     // Internal time of that rising edge, without correction.
+    uint32_t            pairRisingTag;  // SYNC record of that rising edge.
+    // Set if a raw SYNC tag was popped while a rising edge was waiting. It goes after the pulse.
+    uint8_t             pairTagDeferred;
+    // Edges lost because the buffer was full, or by the DMA when the main loop was late.
+    volatile uint32_t   droppedCount;
+    // Edges lost by the TIMx because the capture was overwritten before the ISR read it (CCxOF).
+    volatile uint32_t   overcaptureCount;
+
+    // Timestamps of the channel. Its memory is taken from HWTimers.timestampPool. Use 
+    // pushTimestamp_(), popHWTimerTimestamp() and getHWTimerBufferLength() to access it.
+#if HW_TIMER_COMPACT_TIMESTAMPS
+    CircularBuffer32    data;
+    uint64_t            pushEpoch;      // Epoch of the last pushed marker. Producer only.
+    uint64_t            popEpoch;       // Epoch of the last popped marker. Consumer only.
+#else
     CircularBuffer64    data;
+#endif
 } HWTimerChannel;
 
+// State of the SYNC servo.
+typedef enum HWTimerSyncQuality {
+    // No SYNC, or waiting for its first rising edge. The timestamps are not corrected.
+    HW_TIMER_SYNC_UNSYNCHRONIZED = 0,
+    // Following the SYNC edges, but the servo has not converged yet.
+    HW_TIMER_SYNC_ACQUIRING,
+    // The servo follows the SYNC.
+    HW_TIMER_SYNC_LOCKED,
+    // The SYNC is missing or its edges are being rejected. The last frequency estimated by the 
+    // servo keeps being applied.
+    HW_TIMER_SYNC_HOLDOVER,
+} HWTimerSyncQuality;
+
+// Status of the SYNC servo, read with getSyncStatus().
+typedef struct HWTimerSyncStatus {
+    HWTimerSyncQuality  quality;
+    // Frequency correction applied to the MCU clock (ideal ticks/measured ticks), in Q48.
+    uint64_t            scaleQ48;
+    // Phase error of the last accepted SYNC edge against the servo, in ticks.
+    int64_t             phaseError;
+    // Ticks since the last accepted SYNC edge.
+    uint64_t            ticksSinceLastSync;
+    // SYNC edges rejected because they were too far from any ideal edge.
+    uint32_t            glitchCount;
+} HWTimerSyncStatus;
+
+// SYNC correction from a SYNC edge until the next one. 
+typedef struct HWTimerSyncRecord {
+    uint64_t    measuredTime;   // Internal time of the SYNC edge.
+    uint64_t    idealTime;      // Corrected time of the SYNC edge.
+    // Ideal ticks / measured ticks estimated by the SYNC servo, in Q48 fixed point. Calculated once
+    // per SYNC edge, so each correction is a multiply and shift.
+    uint64_t    scaleQ48;
+    // 1/scaleQ48 in Q48, for removeSyncCorrection_().
+    uint64_t    inverseQ48;
+    uint8_t     synchronized;   // If 0, the timestamps are not corrected.
+} HWTimerSyncRecord;
+
+// Everything needed to turn the raw timestamps of a SYNC tag into MIDDS time.
+typedef struct HWTimerTimebaseDescriptor {
+    uint32_t            syncTag;
+    HWTimerSyncRecord   record;
+    uint64_t            internalTime;   // Internal time when the descriptor was taken.
+} HWTimerTimebaseDescriptor;
+
 // Collection of all Hardware Timers.
 typedef struct HWTimers {
     TIM_HandleTypeDef*  htim1;
@@ -54,7 +492,7 @@ typedef struct HWTimers {
     TIM_HandleTypeDef*  htim4;
     TIM_HandleTypeDef*  htim5;
 
-    // Holds a pointer to the master timer.
+    // Holds a pointer to the master timer, whose counter is the timebase of MIDDS.
     TIM_HandleTypeDef* htimMaster;
 
     float       frequencySYNC;
@@ -70,9 +508,45 @@ typedef struct HWTimers {
     // Number of increments that the high pulse of SYNC should take. Calculated from the frequency
     // and duty cycle of the SYNC signal.
     uint64_t    idealPeriodLowSYNC;
+    // SYNC edges further than this from their ideal time are rejected as glitches.
+    uint64_t    maxPhaseErrorSYNC;
+
+    // SYNC epoch of the last timebase descriptor sent and when it was sent.
+    uint32_t    descriptorEpoch;
+    uint32_t    lastDescriptorTick;
+
+    // Last values returned by getMIDDSTime() and their internal time. Keep the MIDDS time monotonic.
+    uint64_t    lastMIDDSTime;
+    uint64_t    lastInternalTime;
+
+    // Internal time and DWT cycle count before a stall of the CPU. See startHWTimebaseStall().
+    uint64_t    stallStartTime;
+    uint32_t    stallStartCycles;
+    // Changes of the SYSCLK frequency. Each one puts a gap on every channel. See 
+    // markHWTimersClockGap().
+    volatile uint32_t clockGaps;
 
     // Collection of all HW timers.
     HWTimerChannel channels[HW_TIMER_CHANNEL_COUNT];
+    // HWTimerChannel owning each CCx of each TIMx, or NULL if the CCx is not used. Indexed by 
+    // [TIMx - 1][CCx - 1]. Used by the ISRs to go straight from a flag to its channel.
+    HWTimerChannel* ccChannels[HW_TIMER_TIM_COUNT][HW_TIMER_CHANNELS_PER_TIM];
+    // Timebase count minus TIMx count at the same instant, indexed by [TIMx - 1]. The slaves are 
+    // reset by the trigger of TIM1, which reaches them a few ticks late. Measured by 
+    // calibrateHWTimerPhases().
+    int32_t         phaseOffsets[HW_TIMER_TIM_COUNT];
+
+    // Memory for the timestamp buffers of all channels.
+    HWTimerPoolEntry timestampPool[HW_TIMER_POOL_SIZE];
+
+    // DMA channels used by the channels on HW_TIMER_CAPTURE_DMA. HW_TIMER_DMA_SLOT_COUNT long. They
+    // are kept in SRAM1 as they don't fit in the CCM SRAM together with the rest of HWTimers.
+    HWTimerDMASlot* dmaSlots;
+    // Bit N is set when dmaSlots[N] is streaming. Read by the master timer ISR.
+    volatile uint32_t activeDMASlots;
+
+    // Bins of the channels on histogram mode. HW_TIMER_HISTOGRAM_SLOT_COUNT long, in SRAM1.
+    HWTimerHistogramSlot* histogramSlots;
 } HWTimers;
 
 /**************************************** FUNCTION *************************************************
@@ -104,6 +578,22 @@ void initHWTimers(HWTimers* htimers,
 void initHWTimer_(HWTimerChannel* timCh, TIM_HandleTypeDef* htim, uint32_t timChannel,
                   GPIO_TypeDef* gpioPort, uint32_t gpioPin, uint16_t channelNumber, uint8_t isSync);
 
+/**************************************** FUNCTION *************************************************
+ * @brief Auxiliary function that returns the index of a TIMx inside HWTimers.ccChannels.
+ * @param htim. Handler of the TIMx.
+ * @return 0 for TIM1 up to 4 for TIM5. HW_TIMER_TIM_COUNT if the TIMx is not used by the 
+ * HWTimerChannels.
+***************************************************************************************************/
+uint8_t getHWTimerIndex_(TIM_HandleTypeDef* htim);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Auxiliary function that returns the DMAMUX request of a TIMx channel.
+ * @param htim. Handler of the TIMx.
+ * @param timChannel. TIM_CHANNEL_1-4.
+ * @return The DMA_REQUEST_TIMx_CHy or 0 if the TIMx has no DMA request.
+***************************************************************************************************/
+uint32_t getHWTimerDMARequest_(TIM_HandleTypeDef* htim, uint32_t timChannel);
+
 /**************************************** FUNCTION *************************************************
  * @brief Set the SYNC signal parameters.
  * @param htimers. Pointer to the HWTimers struct containing all data related to timers.
@@ -122,12 +612,127 @@ void setSyncParameters(HWTimers* htimers, float frequency, float dutyCycle,
 ***************************************************************************************************/
 void startHWTimers(HWTimers* htimers);
 
+/**************************************** FUNCTION *************************************************
+ * @brief Measures the count offset of each TIMx against the timebase and updates the corrections 
+ * of the channels, so that simultaneous edges on different TIMx get the same timestamp. Each TIMx
+ * is read between two reads of the timebase with the interrupts disabled, and the narrowest of 
+ * HW_TIMER_PHASE_CALIBRATION_SAMPLES reads is kept. Called by startHWTimers() and on command.
+ * @param htimers. Pointer to the HWTimers struct containing all data related to timers.
+***************************************************************************************************/
+void calibrateHWTimerPhases(HWTimers* htimers);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Measures the count offset of a TIMx against the timebase. Only the lower 16 bits of the 
+ * counters are compared, as all TIMx are reset at the same time.
+ * @param master. The timebase TIMx.
+ * @param timer. The TIMx to measure.
+ * @return Timebase count minus TIMx count at the same instant.
+***************************************************************************************************/
+int32_t measureHWTimerPhase_(TIM_TypeDef* master, TIM_TypeDef* timer);
+
 /**************************************** FUNCTION *************************************************
  * @brief Clears all buffers of a HWTimer.
  * @param hwTimer. Pointer to the HWTimerChannel to clean.
 ***************************************************************************************************/
 void clearHWTimer(HWTimerChannel* hwTimer);
 
+/**************************************** FUNCTION *************************************************
+ * @brief Splits the timestamp pool among the channels with needsBuffer set, proportionally to their
+ * bufferWeight. Each channel gets a power of two, at least HW_TIMER_POOL_MIN_CHANNEL_SIZE. The 
+ * buffers whose memory changes lose their stored timestamps, which are added to their droppedCount
+ * and sent as a gap. The rest are kept untouched.
+ * @param htimers. Pointer to the HWTimers struct containing all data related to timers.
+***************************************************************************************************/
+void distributeHWTimerPool(HWTimers* htimers);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Number of entries stored in the buffer of a HWTimerChannel. With compact timestamps, the
+ * epoch markers are also counted, so it is an upper bound of the stored timestamps.
+ * @param hwTimer. Pointer to the HWTimerChannel.
+ * @return The number of entries.
+***************************************************************************************************/
+uint32_t getHWTimerBufferLength(HWTimerChannel* hwTimer);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Pops the next timestamp of a HWTimerChannel, consuming the epoch markers on the way. 
+ * The popped value may be a gap (HW_TIMER_GAP_MARKER set) instead of a timestamp. Consumer only.
+ * @param hwTimer. Pointer to the HWTimerChannel.
+ * @param timestamp. Where the timestamp, (internal time << 1) | GPIO level, will be stored.
+ * @param entryCount. Maximum number of entries that can be popped. It is decremented by the 
+ * number of popped entries. Start it with getHWTimerBufferLength() to only pop the timestamps 
+ * stored up to that point.
+ * @return 1 if a timestamp was popped.
+***************************************************************************************************/
+uint8_t popHWTimerTimestamp(HWTimerChannel* hwTimer, uint64_t* timestamp, uint32_t* entryCount);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Pops the next entry of a HWTimerChannel without the SYNC correction. Besides timestamps
+ * and gaps, the popped value may be a SYNC tag (HW_TIMER_SYNC_TAG_MARKER set), which applies to the
+ * timestamps after it. Consumer only.
+ * @param hwTimer. Pointer to the HWTimerChannel.
+ * @param timestamp. Where the entry will be stored.
+ * @param entryCount. Maximum number of entries that can be popped. See popHWTimerTimestamp().
+ * @return 1 if an entry was popped.
+***************************************************************************************************/
+uint8_t popHWTimerRawTimestamp(HWTimerChannel* hwTimer, uint64_t* timestamp, uint32_t* entryCount);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Pops the entries of a HWTimerChannel capturing both edges until a rising edge is paired 
+ * with its falling edge. The start is (internal time << 1) | 1, and the width is the ticks between
+ * both edges, saturated to UINT32_MAX. With raw timestamps, the start is not corrected and the SYNC
+ * tags are also popped. The gaps and the SYNC tags are popped as they are with a width of 0. 
+ * Consumer only.
+ * @param hwTimer. Pointer to the HWTimerChannel.
+ * @param start. Where the start of the pulse (or the marker) will be stored.
+ * @param width. Where the width of the pulse will be stored.
+ * @param entryCount. Maximum number of entries that can be popped. See popHWTimerTimestamp().
+ * @return 1 if a pulse or a marker was popped.
+***************************************************************************************************/
+uint8_t popHWTimerPulse(HWTimerChannel* hwTimer, uint64_t* start, uint32_t* width, 
+                        uint32_t* entryCount);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Sets whether a HWTimerChannel sends its timestamps raw. The next timebase descriptor is 
+ * sent right away.
+ * @param hwTimer. Pointer to the HWTimerChannel.
+ * @param raw. 1 to send raw timestamps, 0 to send them in MIDDS time.
+***************************************************************************************************/
+void setHWTimerRawTimestamps(HWTimerChannel* hwTimer, uint8_t raw);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Checks if a timebase descriptor has to be sent: one per new SYNC record, or the current 
+ * one every HW_TIMER_DESCRIPTOR_INTERVAL. Call setTimebaseDescriptorSent() once it is sent.
+ * @param htimers. Pointer to the HWTimers.
+ * @param epoch. Where the SYNC epoch of the descriptor will be stored.
+ * @return 1 if a descriptor has to be sent.
+***************************************************************************************************/
+uint8_t getPendingTimebaseDescriptor(HWTimers* htimers, uint32_t* epoch);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Marks the timebase descriptor of a SYNC epoch as sent.
+ * @param htimers. Pointer to the HWTimers.
+ * @param epoch. The SYNC epoch of the sent descriptor.
+***************************************************************************************************/
+void setTimebaseDescriptorSent(HWTimers* htimers, uint32_t epoch);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Copies the timebase descriptor of a SYNC epoch.
+ * @param epoch. The SYNC epoch.
+ * @param descriptor. Where the descriptor will be stored.
+ * @return 1 if the SYNC record of the epoch is still in the history.
+***************************************************************************************************/
+uint8_t getTimebaseDescriptor(uint32_t epoch, HWTimerTimebaseDescriptor* descriptor);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Reads the lost edges counters of a HWTimerChannel.
+ * @param hwTimer. Pointer to the HWTimerChannel.
+ * @param droppedCount. Where the edges lost on the buffer will be stored.
+ * @param overcaptureCount. Where the edges lost on the TIMx will be stored.
+ * @param clear. If set, the counters are cleared after being read.
+***************************************************************************************************/
+void getHWTimerLostEdges(HWTimerChannel* hwTimer, uint32_t* droppedCount, 
+                         uint32_t* overcaptureCount, uint8_t clear);
+
 /**************************************** FUNCTION *************************************************
  * @brief Check if there's enough data to print a HWTimerChannel.
  * @param hwTimer. Pointer to the HWTimer to check.
@@ -135,6 +740,87 @@ void clearHWTimer(HWTimerChannel* hwTimer);
 ***************************************************************************************************/
 uint8_t readyToPrintHWTimer(HWTimerChannel* hwTimer);
 
+/**************************************** FUNCTION *************************************************
+ * @brief Sets the resume rate of the overload fallback of a monitor channel. If the fallback is 
+ * disabled while the channel is overloaded, it goes back to its timestamps right away.
+ * @param hwTimer. Pointer to the HWTimerChannel.
+ * @param rate. Resume rate in edges/s. 0 disables the fallback.
+***************************************************************************************************/
+void setHWTimerOverloadRate(HWTimerChannel* hwTimer, uint32_t rate);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Main loop task of a monitor channel: switches it to statistics if it is losing edges or 
+ * its buffer is 3/4 full. While overloaded, its timestamps are popped into the statistics.
+ * @param hwTimer. Pointer to the HWTimerChannel on monitor mode.
+***************************************************************************************************/
+void processHWTimerOverload(HWTimerChannel* hwTimer);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Reads the statistics of an overloaded channel once every 
+ * HW_TIMER_OVERLOAD_REPORT_INTERVAL ms and starts a new window. If the window was slower than the
+ * resume rate and no edge was lost, the channel goes back to its timestamps.
+ * @param hwTimer. Pointer to the HWTimerChannel on monitor mode.
+ * @param report. Where the statistics will be stored.
+ * @return 1 if a report is due.
+***************************************************************************************************/
+uint8_t getHWTimerOverloadReport(HWTimerChannel* hwTimer, HWTimerStatsReport* report);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Sets whether a HWTimerChannel bins its periods and widths. Enabling it takes one of the 
+ * free histogram slots and clears the histograms. Disabling it frees the slot.
+ * @param hwTimer. Pointer to the HWTimerChannel.
+ * @param enabled. 1 to enable, 0 to disable.
+ * @return 1 if set. 0 if there are no free histogram slots.
+***************************************************************************************************/
+uint8_t setHWTimerHistogramEnabled(HWTimerChannel* hwTimer, uint8_t enabled);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Sets the bins of the histograms of a HWTimerChannel and clears them.
+ * @param hwTimer. Pointer to the HWTimerChannel.
+ * @param binStart. Start of the first bin, in ticks.
+ * @param binWidth. Width of the bins, in ticks. Cannot be 0.
+ * @param binCount. Number of bins, from 1 to HW_TIMER_HISTOGRAM_MAX_BINS.
+ * @return 1 if the bins were set. binWidth*binCount must fit in 32 bits.
+***************************************************************************************************/
+uint8_t setHWTimerHistogramBins(HWTimerChannel* hwTimer, uint32_t binStart, uint32_t binWidth,
+                                uint16_t binCount);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Sets the interval between the reports of the histograms of a HWTimerChannel.
+ * @param hwTimer. Pointer to the HWTimerChannel.
+ * @param interval. Milliseconds between reports. 0 to only send them on request.
+***************************************************************************************************/
+void setHWTimerHistogramInterval(HWTimerChannel* hwTimer, uint32_t interval);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Clears the counts of the histograms of a HWTimerChannel and restarts its report interval.
+ * @param hwTimer. Pointer to the HWTimerChannel.
+***************************************************************************************************/
+void clearHWTimerHistogram(HWTimerChannel* hwTimer);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Clears the counts of one histogram of a HWTimerChannel.
+ * @param hwTimer. Pointer to the HWTimerChannel.
+ * @param kind. The histogram to clear.
+***************************************************************************************************/
+void clearHWTimerHistogramKind(HWTimerChannel* hwTimer, HWTimerHistogramKind kind);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Checks if a histogram of a HWTimerChannel has to be sent. Every reportInterval, the three 
+ * histograms are due. Call setHWTimerHistogramSent() once each one is sent.
+ * @param hwTimer. Pointer to the HWTimerChannel.
+ * @param kind. Where the histogram to send will be stored.
+ * @return 1 if a histogram has to be sent.
+***************************************************************************************************/
+uint8_t getPendingHWTimerHistogram(HWTimerChannel* hwTimer, HWTimerHistogramKind* kind);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Marks a histogram of the current report of a HWTimerChannel as sent.
+ * @param hwTimer. Pointer to the HWTimerChannel.
+ * @param kind. The sent histogram.
+***************************************************************************************************/
+void setHWTimerHistogramSent(HWTimerChannel* hwTimer, HWTimerHistogramKind kind);
+
 /**************************************** FUNCTION *************************************************
  * @brief Enable or disable a HWTimerChannel.
  * @param hwTimer. Pointer to the HWTimer to enable/disable.
@@ -143,25 +829,369 @@ uint8_t readyToPrintHWTimer(HWTimerChannel* hwTimer);
 void setHWTimerEnabled(HWTimerChannel* hwTimer, uint8_t enabled);
 
 /**************************************** FUNCTION *************************************************
- * @brief Calculates the frequency and duty cycle of a hardware timer by using its timestamps. 
- * Warning: it clears the timestamps array! It should not be used on any other than input channels.
+ * @brief Selects how the edges of a HWTimerChannel get captured. Switching to DMA takes one of the
+ * free DMA slots. The channel must be disabled while changing its capture mode.
+ * @param hwTimer. Pointer to the HWTimerChannel.
+ * @param mode. The new capture mode.
+ * @return 1 if the mode was set. 0 if there are no free DMA slots or if the channel is the SYNC.
+***************************************************************************************************/
+uint8_t setHWTimerCaptureMode(HWTimerChannel* hwTimer, HWTimerCaptureMode mode);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Sets the period and the pulse width of a pulse output. Applied the next time the output
+ * is started.
+ * @param hwTimer. Pointer to the HWTimerChannel.
+ * @param period. Period of the pulses, in ticks.
+ * @param width. Duration of the high level, in ticks.
+ * @return 1 if both the high and the low levels last at least HW_TIMER_PULSE_MIN_LENGTH.
+***************************************************************************************************/
+uint8_t setHWTimerPulseParameters(HWTimerChannel* hwTimer, uint64_t period, uint64_t width);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Starts the pulse output of a channel: its CCx is set as output compare and the edges are
+ * placed on the multiples of the period of MIDDS time, following the SYNC correction. The GPIO 
+ * must already be on its TIMx alternate function.
+ * @param hwTimer. Pointer to the HWTimerChannel.
+ * @return 1 if the output was started.
+***************************************************************************************************/
+uint8_t startHWTimerPulseOutput(HWTimerChannel* hwTimer);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Sets a channel as a frequency counter. Its CCx must capture the rising edges with the
+ * HW_TIMER_FREQ_PRESCALER. The captures are counted by the DMA of the channel's slot or, on
+ * HW_TIMER_CAPTURE_ISR, of a free slot taken until the counter is disabled. The channel must be
+ * disabled while changing it.
+ * @param hwTimer. Pointer to the HWTimerChannel.
+ * @param enabled. If 0, the channel goes back to timestamping its edges.
+ * @return 1 if the counter was set, 0 if there's no free DMA slot for it.
+***************************************************************************************************/
+uint8_t setHWTimerFrequencyCounter(HWTimerChannel* hwTimer, uint8_t enabled);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Checks if a channel can be set as a frequency counter.
+ * @param hwTimer. Pointer to the HWTimerChannel.
+ * @return 1 if the channel has a DMA slot or there's a free one.
+***************************************************************************************************/
+uint8_t canHWTimerCountFrequency(HWTimerChannel* hwTimer);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Returns the frequency measured on the last closed gate of a frequency counter. It doesn't
+ * touch the timestamps.
+ * @param hwTimer. Pointer to the HWTimerChannel on frequency mode.
+ * @return The frequency in Hz, or -1 if no gate has been closed in the last 
+ * HW_TIMER_TICKS_UNTIL_FREQ_RECALCULATE ms.
+***************************************************************************************************/
+double getHWTimerCounterFrequency(HWTimerChannel* hwTimer);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Copies the status of the SYNC servo.
+ * @param status. Where the status will be stored.
+***************************************************************************************************/
+void getSyncStatus(HWTimerSyncStatus* status);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Checks that no channel is capturing or generating pulses, so the ISRs of the channels can 
+ * be stalled (by a flash erase) without losing or corrupting edges.
+ * @param htimers. Pointer to the HWTimers struct containing all data related to timers.
+ * @return 1 if the interrupts and DMA requests of all channels are disabled.
+***************************************************************************************************/
+uint8_t areHWTimersIdle(HWTimers* htimers);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Marks a gap on every channel after the SYSCLK has changed its frequency: the TIMx count
+ * at the new rate, but the timestamps are still converted with the ticks of MCU_FREQUENCY. The gap
+ * goes before the next timestamp of each channel, and the open gates of the frequency counters 
+ * are discarded. Can be called from the clock security system NMI.
+ * @param htimers. Pointer to the HWTimers struct containing all data related to timers.
+***************************************************************************************************/
+void markHWTimersClockGap(HWTimers* htimers);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Saves the internal time before the CPU stalls for longer than the master timer period. 
+ * On a 16-bit timebase, the master timer overflows several times during a flash erase but its ISR
+ * only runs once after it. endHWTimebaseStall() adds the missing overflows, counted from the DWT 
+ * cycle counter, which runs from the same clock as the TIMx. Nothing to do on a 32-bit timebase.
+ * @param htimers. Pointer to the HWTimers struct containing all data related to timers.
+***************************************************************************************************/
+void startHWTimebaseStall(HWTimers* htimers);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Adds the master timer overflows lost since startHWTimebaseStall() to the coarse.
+ * @param htimers. Pointer to the HWTimers struct containing all data related to timers.
+***************************************************************************************************/
+void endHWTimebaseStall(HWTimers* htimers);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Main loop tasks of the Hardware Timers: merges the raw captures of the DMA slots into 
+ * their channels' buffers, closes the gates of the frequency counters, feeds the timestamps of the
+ * input channels to their edge statistics and puts the SYNC servo on holdover if the SYNC is lost.
+ * @param htimers. Pointer to the HWTimers struct containing all data related to timers.
+***************************************************************************************************/
+void processHWTimers(HWTimers* htimers);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Starts streaming the captures of a channel in DMA mode.
+ * @param hwTimer. Pointer to the HWTimerChannel.
+***************************************************************************************************/
+void startHWTimerDMA_(HWTimerChannel* hwTimer);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Stops streaming the captures of a channel in DMA mode.
+ * @param hwTimer. Pointer to the HWTimerChannel.
+***************************************************************************************************/
+void stopHWTimerDMA_(HWTimerChannel* hwTimer);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Gives the DMA slot of a channel, taking and configuring a free one if it has none.
+ * @param hwTimer. Pointer to the HWTimerChannel.
+ * @return The slot, or NULL if there's no free slot.
+***************************************************************************************************/
+HWTimerDMASlot* acquireDMASlot_(HWTimerChannel* hwTimer);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Starts the DMA of a slot in circular mode, with its half transfer and transfer complete
+ * interrupts counting its laps. Must be called before the TIMx enables its DMA request.
+ * @param slot. Pointer to the DMA slot.
+ * @param source. Address of the CCR.
+ * @param destination. Address of the memory.
+ * @param length. Transfers of a lap. Must be even.
+ * @return 1 if the DMA started.
+***************************************************************************************************/
+uint8_t startDMASlot_(HWTimerDMASlot* slot, uint32_t source, uint32_t destination, 
+                      uint32_t length);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Updates the count of transfers done by the DMA of a slot from its half laps and its 
+ * counter. Must be called with the interrupts disabled, or from an ISR of the same priority as the
+ * DMA's, so that its interrupt doesn't count the same half lap.
+ * @param slot. Pointer to the DMA slot.
+ * @return The transfers done since the DMA started (free running).
+***************************************************************************************************/
+uint32_t updateDMAWriteCount_(HWTimerDMASlot* slot);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Returns the GPIO level of the next DMA capture of a channel, deduced from its polarity.
+ * @param channel. Pointer to the HWTimerChannel on DMA.
+ * @return 1 if HIGH, 0 if LOW.
+***************************************************************************************************/
+uint8_t nextDMALevel_(HWTimerChannel* channel);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Splits the raw captures of a snapshot of a DMA slot between the period that has just 
+ * finished and the one that has just started. 
+ * 
+ * The captures of the old period were done after the previous snapshot, so their raw values are 
+ * above its counter. Those of the new period were done before this snapshot, so they are below its
+ * counter. Only the raw values between both counters can be of any period. As the raw values of 
+ * each period increase, a capture smaller than the one before is the first of the new period. 
+ * Otherwise, the split is bounded by the captures that are out of the ambiguous range. The captures
+ * that can still go to both periods (only when the whole snapshot has no other edges to tell) are 
+ * counted in ambiguousCount.
+ * @param slot. Pointer to the DMA slot, with readCount on the first capture of the snapshot.
+ * @param snap. The snapshot.
+***************************************************************************************************/
+void splitDMASnapshot_(HWTimerDMASlot* slot, const HWTimerDMASnapshot* snap);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Merges the raw captures of a DMA slot up to the last master timer overflow (or up to now, on
+ * a 32-bit timebase) into the buffer of its channel.
+ * @param slot. Pointer to the DMA slot.
+***************************************************************************************************/
+void mergeDMASlot_(HWTimerDMASlot* slot);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Adds a popped timestamp to the edge statistics of its channel.
+ * @param channel. Pointer to the HWTimerChannel.
+ * @param timestamp. Raw timestamp: internal time shifted left once and the GPIO level on the LSB.
+***************************************************************************************************/
+void accumulateEdge_(HWTimerChannel* channel, uint64_t timestamp);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Adds a completed period to a statistics window.
+ * @param window. Pointer to the window.
+ * @param period. Ticks between both captures.
+ * @param cycles. Cycles of the signal in the period.
+ * @param high. Ticks of high level in the period, only used if hasHigh is set.
+ * @param hasHigh. Set if the falling edge of the period was seen.
+***************************************************************************************************/
+void addPeriodToWindow_(HWTimerStatsWindow* window, uint64_t period, uint32_t cycles, 
+                        uint64_t high, uint8_t hasHigh);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Drops the open period of the statistics because edges were lost.
+ * @param channel. Pointer to the HWTimerChannel.
+ * @param lostCount. Number of lost edges.
+***************************************************************************************************/
+void accumulateGap_(HWTimerChannel* channel, uint32_t lostCount);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Adds a width to a histogram.
+ * @param histogram. Pointer to the histograms of the channel.
+ * @param kind. The histogram where the width goes.
+ * @param ticks. The width, in ticks.
+***************************************************************************************************/
+void addToHistogram_(HWTimerHistogram* histogram, HWTimerHistogramKind kind, uint64_t ticks);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Returns the frequency and duty cycle of a hardware timer from its edge statistics since 
+ * the last call. The timestamps are left untouched. If no period has been completed, the last 
+ * values are returned, or -1 after HW_TIMER_TICKS_UNTIL_FREQ_RECALCULATE ms. The duty cycle is -1 
+ * when capturing a single edge.
  * @param hwTimer. Pointer to the HWTimer to calculate its frequency.
- * @param frequency. Where the frequency will be stored.
+ * @param frequency. Where the frequency will be stored, in Hz.
+ * @param dutyCycle. Where the duty cycle will be stored, in %.
 ***************************************************************************************************/
 void getChannelFrequencyAndDutyCycle(HWTimerChannel* hwTimer, 
                                      double* frequency, double* dutyCycle);
 
 /**************************************** FUNCTION *************************************************
- * @brief Returns the MIDDS time. This time's format is UNIX time in nanoseconds and is synchronized
- * with the SYNC input.
+ * @brief Returns the MIDDS time: the internal time with the SYNC correction, the same as the
+ * timestamps of the monitor messages. It never goes back between calls, unless the MIDDS time is
+ * set. It doesn't disable the interrupts. Call it from the main loop.
  * @param hwTimers. Pointer to the HWTimers.
- * @return The MIDDS time.
+ * @return The MIDDS time, in ticks.
 ***************************************************************************************************/
 uint64_t getMIDDSTime(HWTimers* htimers);
 
+/**************************************** FUNCTION *************************************************
+ * @brief Reads the internal time (coarse + master timer counter). It takes into account a master 
+ * timer overflow that is still pending to be processed, so it can be called from the ISRs and from
+ * the main loop. The read is retried if the timebase changes meanwhile (see timebaseSequence), so
+ * it never disables the interrupts.
+ * @param counter. Where the read master timer counter will be stored. Can be NULL.
+ * @return The internal time, in ticks.
+***************************************************************************************************/
+uint64_t readInternalTime_(uint32_t* counter);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Publishes a new HWTimerSyncRecord. Called by the SYNC ISR or with the interrupts disabled.
+ * @param measuredTime. Internal time of the SYNC edge.
+ * @param idealTime. Corrected time of the SYNC edge.
+ * @param scaleQ48. Correction of the ticks from the SYNC edge on, in Q48.
+ * @param synchronized. If 0, the timestamps won't be corrected.
+***************************************************************************************************/
+void publishSyncRecord_(uint64_t measuredTime, uint64_t idealTime, uint64_t scaleQ48, 
+                        uint8_t synchronized);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Runs the SYNC servo on a SYNC edge. The edge is matched to the nearest ideal edge of its 
+ * level. Its phase error against the current correction feeds a PI loop that estimates the 
+ * frequency of the MCU clock. The correction stays continuous: the phase error is removed by the 
+ * frequency over the next SYNC periods. Edges too far from any ideal edge are rejected, and after
+ * HW_TIMER_SYNC_MAX_GLITCHES of them the servo acquires the SYNC phase again. Called by the SYNC 
+ * ISR.
+ * @param capturedVal. Internal time of the SYNC edge.
+ * @param level. GPIO level after the edge.
+***************************************************************************************************/
+void updateSyncServo_(uint64_t capturedVal, uint8_t level);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Puts the SYNC servo on holdover if no SYNC edge has been accepted in 
+ * HW_TIMER_SYNC_HOLDOVER_PERIODS periods. Called by the main loop.
+***************************************************************************************************/
+void checkSyncHoldover_();
+
+/**************************************** FUNCTION *************************************************
+ * @brief Starts or stops the DMA of a frequency counter.
+ * @param hwTimer. Pointer to the HWTimerChannel on frequency mode.
+ * @param enabled. 1 to start counting.
+***************************************************************************************************/
+void setFrequencyCounterEnabled_(HWTimerChannel* hwTimer, uint8_t enabled);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Reads the count of captures of a frequency counter and the internal time of the last one.
+ * @param hwTimer. Pointer to the HWTimerChannel on frequency mode.
+ * @param count. Where the count of captures will be stored.
+ * @param capture. Where the internal time of the last capture will be stored.
+ * @return 1 if there's been at least one capture and its time is known. If the main loop took too
+ * long to extend the last capture, the gate is discarded and 0 is returned.
+***************************************************************************************************/
+uint8_t readFrequencyCounter_(HWTimerChannel* hwTimer, uint32_t* count, uint64_t* capture);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Closes the gate of a frequency counter once it lasts HW_TIMER_FREQ_GATE_TIME, calculates
+ * its frequency and opens the next gate on the same capture. Called by the main loop.
+ * @param hwTimer. Pointer to the HWTimerChannel on frequency mode.
+***************************************************************************************************/
+void updateFrequencyCounter_(HWTimerChannel* hwTimer);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Converts a MIDDS time to internal time with the current SYNC record. The inverse of 
+ * applySyncCorrection_().
+ * @param idealTime. The MIDDS time, in ticks.
+ * @return The internal time.
+***************************************************************************************************/
+uint64_t removeSyncCorrection_(uint64_t idealTime);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Called on the CCx interrupt of a pulse output. Moves on to the next edge if the armed one
+ * was output and programs the CCR: with the next edge if it is closer than a counter wrap, or with 
+ * a wake-up otherwise.
+ * @param channel. Pointer to the HWTimerChannel.
+***************************************************************************************************/
+void schedulePulseEdge_(HWTimerChannel* channel);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Finds the next edge of a pulse output from the current MIDDS time. Used when it starts and
+ * when the edges have been lost (the ISR was late by more than HW_TIMER_PULSE_MAX_SKIPPED_PERIODS 
+ * or the MIDDS time was set). Takes a 64-bit modulo, so it's kept out of the usual ISR path.
+ * @param channel. Pointer to the HWTimerChannel.
+ * @param internalTime. The current internal time.
+***************************************************************************************************/
+void alignPulseOutput_(HWTimerChannel* channel, uint64_t internalTime);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Sets the output compare mode (OCxM) of the CCx of a channel.
+ * @param channel. Pointer to the HWTimerChannel.
+ * @param ocMode. TIM_OCMODE_x, as for channel 1.
+***************************************************************************************************/
+void setOutputCompareMode_(HWTimerChannel* channel, uint32_t ocMode);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Applies the SYNC corrections to a captured value in internal time. Called by the 
+ * consumers of the timestamps.
+ * 
+ * The product is rounded to the nearest tick of the exact delta*scale (delta being the distance
+ * to the SYNC edge), and it doesn't overflow while the result fits in 64 bits, so the servo can 
+ * extrapolate for as long as needed on holdover. With the Q48 scale rounded as well, the error 
+ * against the exact delta*ideal/measured stays below 0.5 + delta/2^49 ticks: under 1 tick up to 
+ * 2^48 ticks (20 days) from the SYNC edge (checked by sw/test).
+ * @param capturedVal. The raw capture with the coarse already added.
+ * @param syncTag. The SYNC record that was current when the capture was stored.
+ * @return The corrected time.
+***************************************************************************************************/
+uint64_t applySyncCorrection_(uint64_t capturedVal, uint32_t syncTag);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Starts the buffer of a HWTimerChannel. Must not be called while the producer is running.
+ * @param channel. The HWTimerChannel.
+ * @param storage. Memory from the pool, or NULL if the channel has no buffer.
+ * @param size. Entries of storage.
+***************************************************************************************************/
+void initTimestampBuffer_(HWTimerChannel* channel, HWTimerPoolEntry* storage, uint32_t size);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Counts the edges stored in the buffer of a HWTimerChannel, plus the ones lost in its gap
+ * markers, without popping them. Must not be called while the producer is running.
+ * @param channel. The HWTimerChannel.
+ * @return The count of edges.
+***************************************************************************************************/
+uint32_t countStoredEdges_(HWTimerChannel* channel);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Pushes a timestamp into the buffer of a HWTimerChannel. If there's a pending gap, it is
+ * pushed first. With compact timestamps, an epoch marker is pushed along if the epoch has changed
+ * since the last push. Either all of them are pushed or none. Producer only.
+ * @param channel. The HWTimerChannel.
+ * @param timestamp. (internal time << 1) | GPIO level.
+ * @return 1 if the push was successful, 0 if the buffer is full.
+***************************************************************************************************/
+uint8_t pushTimestamp_(HWTimerChannel* channel, uint64_t timestamp);
+
 /**************************************** FUNCTION *************************************************
  * @brief Gets the stored value in a TIM capture input register and stores it in the related 
- * HWTimer chanel circular buffer.
+ * HWTimer chanel circular buffer. The caller must have checked that the channel has a pending and
+ * enabled capture.
  * @param htim. Timer handler that is requesting the ISR.
  * @param addCoarseIncrement. If set, this function is being called from a reset timer event so it
  * checks if the current captured value belongs to the current coarse value or the next one.
@@ -169,11 +1199,32 @@ uint64_t getMIDDSTime(HWTimers* htimers);
 void saveTimestamp_(HWTimerChannel* htim, uint8_t addCoarseIncrement);
 
 /**************************************** FUNCTION *************************************************
- * @brief ISR function called on a Capture Input Event (when an edge has triggered a TIM and there's
- * a new timestamp to process).
- * @param htim. Timer handler that is requesting the ISR.
+ * @brief Saves the timestamps of all pending and enabled captures of a TIMx. Only the set bits of
+ * SR & DIER are visited.
+ * @param instance. The TIMx registers.
+ * @param ccChannels. The HWTimerChannels owning each CCx of the TIMx.
+ * @param addCoarseIncrement. Same as in saveTimestamp_().
+***************************************************************************************************/
+void savePendingTimestamps_(TIM_TypeDef* instance, HWTimerChannel* const* ccChannels,
+                            uint8_t addCoarseIncrement);
+
+/**************************************** FUNCTION *************************************************
+ * @brief ISR functions called on a Capture Input Event (when an edge has triggered a TIMx and 
+ * there's a new timestamp to process). There's one for each TIMx so that the TIMx and its channels
+ * are known at compile time.
+***************************************************************************************************/
+void captureInputTIM1ISR_();
+void captureInputTIM2ISR_();
+void captureInputTIM3ISR_();
+void captureInputTIM4ISR_();
+void captureInputTIM5ISR_();
+
+/**************************************** FUNCTION *************************************************
+ * @brief ISR function called on the half transfer and transfer complete of the DMA of a slot. 
+ * Counts its half laps.
+ * @param slotIndex. Index of the slot in HWTimers.dmaSlots.
 ***************************************************************************************************/
-void captureInputISR_(TIM_HandleTypeDef* htim);
+void dmaSlotISR_(uint8_t slotIndex);
 
 /**************************************** FUNCTION *************************************************
  * @brief ISR function called on a Reset Event (when the TIM goes back to 0, either because and 
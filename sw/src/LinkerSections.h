@@ -0,0 +1,34 @@
+/***************************************************************************************************
+ * @file LinkerSections.h
+ * @brief Attributes to place code and data on the memory sections defined in the linker script.
+ *
+ * @project MIDDS
+ * @version 1.0
+ * @date    2025-08-05
+ * @author  @dabecart
+ *
+ * @license This project is licensed under the MIT License - see the LICENSE file for details.
+***************************************************************************************************/
+
+#ifndef LINKER_SECTIONS_h
+#define LINKER_SECTIONS_h
+
+// If 1, the capture hot path (timer ISRs and their data) runs from the CCM SRAM. The CCM SRAM has
+// no wait states, while the flash at 160 MHz has four (partially hidden by the ART accelerator, but
+// not on a cache miss). Set to 0 to compare both with the profiler.
+#define LINKER_USE_CCM_SRAM     1
+
+#if LINKER_USE_CCM_SRAM
+// Code copied from flash to the CCM SRAM by the startup.
+#define CCM_CODE    __attribute__((section(".ccmtext")))
+// Initialized data copied from flash to the CCM SRAM by the startup.
+#define CCM_DATA    __attribute__((section(".ccmdata")))
+// Uninitialized data on the CCM SRAM, zeroed by the startup.
+#define CCM_BSS     __attribute__((section(".ccmbss")))
+#else
+#define CCM_CODE
+#define CCM_DATA
+#define CCM_BSS
+#endif
+
+#endif // LINKER_SECTIONS_h
@@ -13,7 +13,8 @@
 
 #include "MainMCU.h"
 
-HWTimers hwTimers;
+// The HWTimers are used by the timer ISRs, so they are kept in the CCM SRAM.
+CCM_BSS HWTimers hwTimers;
 ChannelController chCtrl;
 
 void initMCU(TIM_HandleTypeDef* htim1,
@@ -25,6 +26,11 @@ void initMCU(TIM_HandleTypeDef* htim1,
              I2C_HandleTypeDef* hi2c1,
              I2C_HandleTypeDef* hi2c2)
 {
+    // The clock goes first: the profiler and the timers count its ticks.
+    initClockManager();
+
+    initProfiler();
+
     initComms();
 
     initHWTimers(&hwTimers, htim1, htim2, htim3, htim4, htim5);
@@ -45,29 +51,73 @@ void initMCU(TIM_HandleTypeDef* htim1,
 }
 
 void loopMCU() {
+    PROFILER_START();
+
+    // Restore the SYSCLK if the reference has been lost.
+    processClockManager();
+
     // Receive commands and generate the responses.
     receiveData();
 
+    // Merge the captures done by DMA.
+    processHWTimers(&hwTimers);
+
     // Generate the recurrent messages.
     ChannelMessage tempMsg = {};
     Channel* ch;
+    uint8_t sendsRawTimestamps = 0;
     for(uint16_t i = 0; i < HW_TIMER_CHANNEL_COUNT; i++) {
         ch = chCtrl.channels + i;
 
         // Recurrent message for Monitor mode.
         if((ch->mode == CHANNEL_MONITOR_BOTH_EDGES) || 
            (ch->mode == CHANNEL_MONITOR_RISING_EDGES) || 
-           (ch->mode == CHANNEL_MONITOR_FALLING_EDGES)) {
+           (ch->mode == CHANNEL_MONITOR_FALLING_EDGES) ||
+           (ch->mode == CHANNEL_MONITOR_PULSES)) {
+            if(ch->type == CHANNEL_TIMER) {
+                HWTimerChannel* hwTimer = ch->data.timer.timerHandler;
+                sendsRawTimestamps |= hwTimer->rawTimestamps;
+
+                // Channels with more edges than what can be sent switch to statistics.
+                processHWTimerOverload(hwTimer);
+                if(getHWTimerOverloadReport(hwTimer, &tempMsg.statistics.report)) {
+                    tempMsg.statistics.channel = hwTimer->channelNumber;
+                    encodeGPIOMessage(GPIO_MSG_STATISTICS, tempMsg);
+                }
+            }
+
             if((ch->type == CHANNEL_TIMER) && readyToPrintHWTimer(ch->data.timer.timerHandler)) {
                 tempMsg.monitor = ch->data.timer.timerHandler;
-                encodeGPIOMessage(GPIO_MSG_MONITOR, tempMsg); 
+                encodeGPIOMessage((ch->mode == CHANNEL_MONITOR_PULSES) ? 
+                                  GPIO_MSG_PULSES : GPIO_MSG_MONITOR, tempMsg); 
             }else if(ch->type == CHANNEL_GPIO) {
                 // TODO: Not implemented.
                 continue;
             }
         }
+
+        // Recurrent messages for Histogram mode.
+        if((ch->mode == CHANNEL_HISTOGRAM) && (ch->type == CHANNEL_TIMER)) {
+            HWTimerChannel* hwTimer = ch->data.timer.timerHandler;
+            tempMsg.histogram.channel = hwTimer->channelNumber;
+            tempMsg.histogram.action = COMMS_HISTOGRAM_READ_AND_CLEAR;
+            while(getPendingHWTimerHistogram(hwTimer, &tempMsg.histogram.kind)) {
+                if(!encodeGPIOMessage(GPIO_MSG_HISTOGRAM, tempMsg)) break;
+                setHWTimerHistogramSent(hwTimer, tempMsg.histogram.kind);
+            }
+        }
+    }
+
+    // The computer needs the timebase descriptors to convert the raw timestamps.
+    uint32_t epoch;
+    while(sendsRawTimestamps && getPendingTimebaseDescriptor(&hwTimers, &epoch)) {
+        tempMsg.timebase.epoch = epoch;
+        if(!encodeGPIOMessage(GPIO_MSG_TIMEBASE, tempMsg)) break;
+        setTimebaseDescriptorSent(&hwTimers, epoch);
     }
 
     // Send the data.
     sendData();
+
+    PROFILER_END(PROFILER_SITE_LOOP_MCU);
 }
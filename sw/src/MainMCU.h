@@ -21,12 +21,28 @@
 #include "HWTimers.h"
 #include "Comms.h"
 #include "ChannelController.h"
+#include "Profiler.h"
+#include "ClockManager.h"
 
 // vvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvv DEFINES vvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvvv
 #define MCU_TX_IN_ASCII 0
 
 #define MCU_FREQUENCY 160000000ULL
 
+// Duration of a tick in ns (1e9/MCU_FREQUENCY) as a reduced fraction: 6.25 ns at 160 MHz. The 
+// conversions between ticks and ns are exact integer operations with it.
+#define MCU_TICK_NS_NUMERATOR   25
+#define MCU_TICK_NS_DENOMINATOR 4
+
+#if (MCU_FREQUENCY*MCU_TICK_NS_NUMERATOR) != (1000000000ULL*MCU_TICK_NS_DENOMINATOR)
+#error "MCU_TICK_NS_NUMERATOR/MCU_TICK_NS_DENOMINATOR must be 1e9/MCU_FREQUENCY."
+#endif
+
+// If 1, the timestamps are converted to ns with integer operations. The floating point conversion
+// is soft-float for 64-bit values on the Cortex-M4 and loses precision above 2^53 ns. Set to 0 to 
+// compare both with the profiler.
+#define MCU_EXACT_TIME_CONVERSION 1
+
 #define MCU_CHANNEL_PRINT_INTERVAL 10 // ms
 
 /**************************************** FUNCTION *************************************************
@@ -0,0 +1,48 @@
+/***************************************************************************************************
+ * @file Profiler.c
+ * @brief Cycle counting of the critical functions of MIDDS with the DWT cycle counter.
+ *
+ * @project MIDDS
+ * @version 1.0
+ * @date    2025-08-04
+ * @author  @dabecart
+ *
+ * @license This project is licensed under the MIT License - see the LICENSE file for details.
+***************************************************************************************************/
+
+#include "Profiler.h"
+
+#include <string.h>
+
+ProfilerSiteStats profilerSites[PROFILER_SITE_COUNT];
+
+void initProfiler() {
+    for(uint16_t i = 0; i < PROFILER_SITE_COUNT; i++) {
+        clearProfilerSite(i);
+    }
+
+    // The DWT is part of the debug block, which has to be enabled even without a debugger.
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+void clearProfilerSite(ProfilerSite site) {
+    if(site >= PROFILER_SITE_COUNT) return;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    memset(profilerSites + site, 0, sizeof(ProfilerSiteStats));
+    profilerSites[site].minCycles = UINT32_MAX;
+    __set_PRIMASK(primask);
+}
+
+uint8_t getProfilerSiteStats(ProfilerSite site, ProfilerSiteStats* stats) {
+    if((site >= PROFILER_SITE_COUNT) || (stats == NULL)) return 0;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    memcpy(stats, profilerSites + site, sizeof(ProfilerSiteStats));
+    __set_PRIMASK(primask);
+    return 1;
+}
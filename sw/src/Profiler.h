@@ -0,0 +1,98 @@
+/***************************************************************************************************
+ * @file Profiler.h
+ * @brief Cycle counting of the critical functions of MIDDS with the DWT cycle counter.
+ *
+ * @project MIDDS
+ * @version 1.0
+ * @date    2025-08-04
+ * @author  @dabecart
+ *
+ * @license This project is licensed under the MIT License - see the LICENSE file for details.
+***************************************************************************************************/
+
+#ifndef PROFILER_h
+#define PROFILER_h
+
+#include <stdint.h>
+
+#include "stm32g4xx_hal.h"
+
+// If 0, all PROFILER_START() and PROFILER_END() get removed on compilation.
+#define PROFILER_ENABLED                1
+
+// Each bucket N counts the samples that took [2^N, 2^(N+1)) cycles. The last bucket also counts
+// all the samples above it (2^19 cycles = 3.3 ms at 160 MHz).
+#define PROFILER_HISTOGRAM_BUCKETS      20
+
+// Functions being profiled.
+typedef enum ProfilerSite {
+    PROFILER_SITE_SAVE_TIMESTAMP = 0,
+    PROFILER_SITE_RESTART_MASTER_TIMER,
+    PROFILER_SITE_ENCODE_MONITOR,
+    PROFILER_SITE_LOOP_MCU,
+    PROFILER_SITE_CONVERT_TIME,
+    PROFILER_SITE_COUNT
+} ProfilerSite;
+
+// Cycles spent by a ProfilerSite.
+typedef struct ProfilerSiteStats {
+    uint32_t    count;
+    uint32_t    minCycles;
+    uint32_t    maxCycles;
+    uint64_t    totalCycles;
+    uint32_t    histogram[PROFILER_HISTOGRAM_BUCKETS];
+} ProfilerSiteStats;
+
+#if PROFILER_ENABLED
+// Place at the start of the profiled code.
+#define PROFILER_START()    uint32_t profilerStartCycles_ = DWT->CYCCNT
+// Place at the end of the profiled code, on the same scope as PROFILER_START().
+#define PROFILER_END(site)  addProfilerSample_((site), DWT->CYCCNT - profilerStartCycles_)
+#else
+#define PROFILER_START()
+#define PROFILER_END(site)
+#endif
+
+/**************************************** FUNCTION *************************************************
+ * @brief Starts the DWT cycle counter and clears all the statistics.
+***************************************************************************************************/
+void initProfiler();
+
+/**************************************** FUNCTION *************************************************
+ * @brief Clears the statistics of a site.
+ * @param site. The ProfilerSite to clear.
+***************************************************************************************************/
+void clearProfilerSite(ProfilerSite site);
+
+/**************************************** FUNCTION *************************************************
+ * @brief Copies the statistics of a site. It can be called while the site is being profiled from
+ * an ISR, the copy is done with the interrupts disabled.
+ * @param site. The ProfilerSite to read.
+ * @param stats. Where the statistics will be copied.
+ * @return 1 if the site is valid.
+***************************************************************************************************/
+uint8_t getProfilerSiteStats(ProfilerSite site, ProfilerSiteStats* stats);
+
+/**************************************** EXTERNALS ***********************************************/
+extern ProfilerSiteStats profilerSites[PROFILER_SITE_COUNT];
+
+/**************************************** FUNCTION *************************************************
+ * @brief Adds a sample to a site. Each site must only be profiled from a single context (one ISR
+ * priority or the main loop), so no locking is needed.
+ * @param site. The ProfilerSite.
+ * @param cycles. Cycles spent on this sample.
+***************************************************************************************************/
+static inline void addProfilerSample_(ProfilerSite site, uint32_t cycles) {
+    ProfilerSiteStats* stats = profilerSites + site;
+    stats->count++;
+    stats->totalCycles += cycles;
+    if(cycles < stats->minCycles) stats->minCycles = cycles;
+    if(cycles > stats->maxCycles) stats->maxCycles = cycles;
+
+    // The bucket is the position of the MSB of the cycles.
+    uint32_t bucket = (cycles == 0) ? 0 : (31 - __CLZ(cycles));
+    if(bucket >= PROFILER_HISTOGRAM_BUCKETS) bucket = PROFILER_HISTOGRAM_BUCKETS - 1;
+    stats->histogram[bucket]++;
+}
+
+#endif // PROFILER_h
@@ -0,0 +1,136 @@
+/***************************************************************************************************
+ * @file TestFixedPoint.c
+ * @brief Host test of the Q48 arithmetic of the SYNC corrections against a 128-bit reference.
+ *
+ * The SYNC servo corrects a capture with ideal = syncIdeal + mulQ48(delta, scaleQ48), where the
+ * scale is the ratio of the ideal and measured SYNC periods. This checks that divQ48() and
+ * mulQ48() match the exact 128-bit results rounded to the nearest, and that the error against
+ * delta*ideal/measured stays below 1 tick, for SYNC periods of up to 100 s with up to +-100 ppm of
+ * drift and distances to the SYNC edge of up to 2^35 ticks (3.5 minutes at 160 MHz).
+ *
+ * @project MIDDS
+ * @version 1.0
+ * @date    2025-08-09
+ * @author  @dabecart
+ *
+ * @license This project is licensed under the MIT License - see the LICENSE file for details.
+***************************************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "FixedPoint.h"
+
+#define TEST_ITERATIONS         2000000
+#define TEST_MAX_DRIFT_PPM      100
+#define TEST_MAX_DELTA_BITS     35
+// 0.01 Hz SYNC at 160 MHz.
+#define TEST_MAX_PERIOD         16000000000ULL
+
+typedef unsigned __int128 uint128_t;
+
+static uint64_t rngState = 0x9E3779B97F4A7C15ULL;
+
+// xorshift64*: deterministic, so any failure can be reproduced.
+static uint64_t random64() {
+    rngState ^= rngState >> 12;
+    rngState ^= rngState << 25;
+    rngState ^= rngState >> 27;
+    return rngState * 0x2545F4914F6CDD1DULL;
+}
+
+static uint64_t randomBelow(uint64_t limit) {
+    return random64() % limit;
+}
+
+// round(numerator * 2^48 / denominator), half away from zero.
+static uint64_t referenceDivQ48(uint64_t numerator, uint64_t denominator) {
+    return (uint64_t)((((uint128_t) numerator << 49) / denominator + 1) >> 1);
+}
+
+// round(value * scale / 2^48).
+static uint64_t referenceMulQ48(uint64_t value, uint64_t scale) {
+    return (uint64_t)(((uint128_t) value * scale + ((uint128_t) 1 << 47)) >> 48);
+}
+
+int main() {
+    uint32_t failures = 0;
+    double worstError = 0;
+
+    for(uint32_t i = 0; i < TEST_ITERATIONS; i++) {
+        uint64_t measured = 1 + randomBelow(TEST_MAX_PERIOD);
+        // ideal = measured * (1 + drift), drift in [-100, 100] ppm.
+        int64_t driftPPB = (int64_t) randomBelow(2*TEST_MAX_DRIFT_PPM*1000 + 1) -
+                           TEST_MAX_DRIFT_PPM*1000;
+        uint64_t ideal = (uint64_t)(((__int128) measured * (1000000000 + driftPPB)) / 1000000000);
+        if(ideal == 0) ideal = 1;
+
+        uint64_t scaleQ48 = (uint64_t) divQ48((int64_t) ideal, measured);
+        if(scaleQ48 != referenceDivQ48(ideal, measured)) {
+            printf("FAIL divQ48: ideal=%llu measured=%llu got=0x%016llx expected=0x%016llx\n",
+                   (unsigned long long) ideal, (unsigned long long) measured,
+                   (unsigned long long) scaleQ48,
+                   (unsigned long long) referenceDivQ48(ideal, measured));
+            failures++;
+            continue;
+        }
+
+        // The phase errors of the servo are signed and well below the elapsed time.
+        int64_t phaseError = (int64_t) randomBelow(measured/4 + 1) - (int64_t)(measured/8);
+        int64_t errorQ48 = divQ48(phaseError, measured);
+        uint64_t phaseMagnitude = (phaseError < 0) ? -(uint64_t) phaseError : (uint64_t) phaseError;
+        int64_t expectedError = (int64_t) referenceDivQ48(phaseMagnitude, measured);
+        if(phaseError < 0) expectedError = -expectedError;
+        if(errorQ48 != expectedError) {
+            printf("FAIL signed divQ48: phase=%lld measured=%llu got=%lld expected=%lld\n",
+                   (long long) phaseError, (unsigned long long) measured,
+                   (long long) errorQ48, (long long) expectedError);
+            failures++;
+            continue;
+        }
+
+        // Log-uniform distances, so that short and long extrapolations are equally covered.
+        uint32_t bits = randomBelow(TEST_MAX_DELTA_BITS + 1);
+        uint64_t delta = (bits == 0) ? 0 : (random64() >> (64 - bits));
+
+        uint64_t result = mulQ48(delta, scaleQ48);
+        if(result != referenceMulQ48(delta, scaleQ48)) {
+            printf("FAIL mulQ48: delta=%llu scale=0x%016llx got=%llu expected=%llu\n",
+                   (unsigned long long) delta, (unsigned long long) scaleQ48,
+                   (unsigned long long) result,
+                   (unsigned long long) referenceMulQ48(delta, scaleQ48));
+            failures++;
+            continue;
+        }
+
+        // |result - delta*ideal/measured| < 1, with the exact value kept as a fraction over
+        // measured.
+        uint128_t exactNumerator = (uint128_t) delta * ideal;
+        uint128_t resultNumerator = (uint128_t) result * measured;
+        uint128_t errorNumerator = (resultNumerator > exactNumerator) ?
+                                   (resultNumerator - exactNumerator) :
+                                   (exactNumerator - resultNumerator);
+        if(errorNumerator >= measured) {
+            printf("FAIL bound: delta=%llu ideal=%llu measured=%llu got=%llu\n",
+                   (unsigned long long) delta, (unsigned long long) ideal,
+                   (unsigned long long) measured, (unsigned long long) result);
+            failures++;
+            continue;
+        }
+        double error = (double) errorNumerator / measured;
+        if(error > worstError) worstError = error;
+
+        // Any operands whose product fits, to go through every carry of the partial products.
+        uint64_t value = random64();
+        uint64_t scale = random64() >> (16 + randomBelow(48));
+        if(mulQ48(value, scale) != referenceMulQ48(value, scale)) {
+            printf("FAIL mulQ48 carries: value=0x%016llx scale=0x%016llx\n",
+                   (unsigned long long) value, (unsigned long long) scale);
+            failures++;
+        }
+    }
+
+    printf("TestFixedPoint: %u iterations, %u failures, worst error %.4f ticks.\n",
+           TEST_ITERATIONS, failures, worstError);
+    return (failures == 0) ? 0 : 1;
+}